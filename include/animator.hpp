@@ -4,17 +4,17 @@
 // Need to include this before tweeny
 
 #include <tweeny/tweeny.h>
-#include <wx/event.h>
-#include <wx/timer.h>
 
 #include <chrono>
 #include <functional>
 
+#include "frame_clock.hpp"
 #include "util.hpp"
 
-template <typename T> class Animator : public wxEvtHandler {
+// Stepped by the FrameClock, so never faster than the display refreshes
+template <typename T> class Animator {
 	bool isAnimating;
-	wxTimer timer;
+	int clockId;  // In FrameClock, -1 while not running
 	tweeny::tween<T> tween;
 	std::chrono::steady_clock::time_point startTime;
 
@@ -22,10 +22,10 @@ template <typename T> class Animator : public wxEvtHandler {
 	std::function<void()> onEnd;
 
    public:
-	Animator() : isAnimating(false) {
-		timer.SetOwner(this);
-		Bind(wxEVT_TIMER, &Animator::OnTimer, this);
-	}
+	Animator() : isAnimating(false), clockId(-1) {}
+	~Animator() { stopClock(); }
+	Animator(const Animator&) = delete;
+	Animator& operator=(const Animator&) = delete;
 
 	void Reset() { startTime = std::chrono::steady_clock::now(); }
 	bool IsRunning() const { return isAnimating && tween.progress() < 1.0f; }
@@ -48,25 +48,31 @@ template <typename T> class Animator : public wxEvtHandler {
 		this->onStep = onStep;
 		this->onEnd = onEnd;
 		if (onStep) { onStep(start); }
-		timer.Start(std::max(durationMs / 100, 1));
+		if (clockId < 0) {
+			clockId = FrameClock::get().add(
+				[this](auto now) { Process(now); });
+		}
 	}
 
 	void End() {
 		isAnimating = false;
-		timer.Stop();
+		stopClock();
 		if (onEnd) { onEnd(); }
 	}
 
    private:
-	void Process() {
+	void stopClock() {
+		if (clockId < 0) { return; }
+		FrameClock::get().remove(clockId);
+		clockId = -1;
+	}
+
+	void Process(std::chrono::steady_clock::time_point now) {
 		using namespace std::chrono;
-		auto now = steady_clock::now();
 		auto elapsedMs =
 			duration_cast<duration<int, std::milli>>(now - startTime).count();
 		auto val = tween.seek(elapsedMs, true);
 		if (onStep) { onStep(val); }
 		if (tween.progress() >= 1.0f) { End(); }
 	}
-
-	void OnTimer(wxTimerEvent& event) { Process(); }
 };
@@ -7,11 +7,17 @@
 #include <cstdint>
 #include <filesystem>
 #include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 class ArchiveFile {
 	friend void processArchiveFile(
 		const std::filesystem::path& filePath,
 		std::function<void(const ArchiveFile&)> func);
+	friend class ArchiveReader;
 
 	struct archive* archivePtr;
 	archive_entry* entry;
@@ -22,10 +28,93 @@ class ArchiveFile {
    public:
 	std::filesystem::path path() const;
 	int64_t size() const;
+	int64_t offset() const;
 	bool isFile() const;
 	void writeContent(const std::filesystem::path& filePath) const;
+	std::vector<uint8_t> readContent() const;
 };
 
 void processArchiveFile(
 	const std::filesystem::path& filePath,
 	std::function<void(const ArchiveFile&)> func);
+
+// Size and modification time of an archive, used to validate caches
+struct ArchiveStamp {
+	int64_t size;
+	int64_t time;
+	bool operator==(const ArchiveStamp&) const = default;
+};
+
+std::optional<ArchiveStamp> archiveStamp(const std::filesystem::path& path);
+
+struct ArchiveEntry {
+	std::filesystem::path path;
+	int64_t size;
+	int64_t offset;			 // Position of the entry's header in the archive
+	int64_t compressedSize;	 // -1 if unknown
+	int method;				 // ZIP compression method, -1 if unknown
+};
+
+// Table of the regular files inside an archive. ZIP archives are indexed from
+// their central directory and can be read at random, other formats fall back
+// to a header scan and have to be read sequentially.
+class ArchiveIndex {
+	std::filesystem::path archivePath;
+	std::vector<ArchiveEntry> entries;
+	std::unordered_map<std::string, size_t> lookup;
+	bool seekable;
+
+	bool readCentralDirectory();
+	void readHeaders();
+	void buildLookup();
+
+   public:
+	ArchiveIndex(const std::filesystem::path& archivePath);
+	// Only reads the ZIP central directory, nullopt for other archives
+	static std::optional<ArchiveIndex> fromCentralDirectory(
+		const std::filesystem::path& archivePath);
+	// Restore an index built earlier for the same archive
+	ArchiveIndex(
+		const std::filesystem::path& archivePath,
+		std::vector<ArchiveEntry> entries, bool seekable);
+
+	const std::filesystem::path& path() const { return archivePath; }
+	const std::vector<ArchiveEntry>& files() const { return entries; }
+	const ArchiveEntry* find(const std::filesystem::path& entryPath) const;
+	bool isSeekable() const { return seekable; }
+	// Adds an entry found after indexing, known paths are skipped
+	void add(const ArchiveEntry& entry);
+};
+
+// Extracts single entries using an ArchiveIndex. Seekable archives are read
+// directly at the entry's offset, others keep a sequential cursor open so
+// that reading entries in archive order never restarts from the beginning.
+// Reads are serialized, so a reader can be shared between threads.
+class ArchiveReader {
+	ArchiveIndex archiveIndex;
+	struct archive* cursor;
+	int64_t cursorOffset;
+	std::mutex lock;
+
+	void closeCursor();
+	void readDirect(
+		const ArchiveEntry& entry,
+		std::function<void(const ArchiveFile&)> func);
+	void readSequential(
+		const ArchiveEntry& entry,
+		std::function<void(const ArchiveFile&)> func);
+
+   public:
+	ArchiveReader(const std::filesystem::path& archivePath);
+	ArchiveReader(ArchiveIndex index);
+	~ArchiveReader();
+	ArchiveReader(const ArchiveReader&) = delete;
+	ArchiveReader& operator=(const ArchiveReader&) = delete;
+
+	const ArchiveIndex& index() const { return archiveIndex; }
+	// Makes entries seen while streaming the archive readable
+	void add(const std::vector<ArchiveEntry>& entries);
+	void read(
+		const std::filesystem::path& entryPath,
+		std::function<void(const ArchiveFile&)> func);
+};
@@ -1,21 +1,60 @@
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
 #include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "image_utils.hpp"
+#include "page_manifest.hpp"
+
+class ArchiveReader;
 
 extern const std::filesystem::path cacheDirectory;
 extern const int THUMB_DIM;
 
+// Persistent per-user directory, unlike cacheDirectory it survives exit
+std::filesystem::path getDataDirectory();
+// Where the page manifest of `comic` is kept between runs
+std::filesystem::path getManifestPath(const std::filesystem::path& comic);
+
 class Comic {
 	std::filesystem::path comicPath;
 	int size;
+	std::shared_ptr<ArchiveReader> reader;
+	std::optional<PageManifest> manifest;
+	bool manifestChanged;
+
+	void saveManifest();
 
    public:
 	Comic(const std::filesystem::path& comicPath);
-	void load(std::function<void(int i)> progress = nullptr);
+	// For comics whose page count is already known, skips the archive scan
+	Comic(const std::filesystem::path& comicPath, int size);
+	// Only lists the pages, their content is read on demand by readPage.
+	// False for archives that have to be read in order and weren't indexed
+	// before, their pages are streamed in with addStreamedPage instead.
+	bool load();
+	// Sorts a page into reading order and makes it readable, returns where
+	// it went
+	int addStreamedPage(const ArchiveEntry& page);
+	// Indexes the comic from every entry seen while streaming. True if the
+	// pages had to be reordered.
+	bool finishStream(std::vector<ArchiveEntry> entries);
 	void unload();
+	std::vector<uint8_t> readPage(int i);
+	// Thread safe, unlike indices the path of a page never changes
+	std::vector<uint8_t> readPage(const std::filesystem::path& page);
+	// Size of a page as cached from an earlier decode, wxDefaultSize if
+	// the page wasn't decoded yet
+	wxSize pageSize(int i) const;
+	void setPageSize(int i, const wxSize& size);
 	int length() const;
 	std::string getName() const;
+	const std::filesystem::path& path() const { return comicPath; }
 	std::filesystem::path coverPage;
+	Thumbnail thumbnail;
 	std::vector<std::filesystem::path> pages;
 };
@@ -3,37 +3,88 @@
 #include <wx/graphics.h>
 #include <wx/panel.h>
 
+#include <atomic>
+#include <deque>
 #include <filesystem>
 #include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <vector>
 
 #include "animator.hpp"
 #include "comic.hpp"
 #include "comic_viewer.hpp"
 #include "image_utils.hpp"
+#include "layout.hpp"
+#include "prefetcher.hpp"
+#include "thumbnail_pack.hpp"
 
 class ComicGallery : public wxPanel {
-	std::vector<Comic> comics;
+	// In comicOrder(), held by pointer so the open comic stays put while
+	// others are published around it
+	std::vector<std::unique_ptr<Comic>> comics;
+	// Pool image of each comic's cover, the pool only ever grows
+	std::vector<int> covers;
+	int nextCover;
+	// Width over height of each cover, so layout needs no pool lookups
+	std::vector<double> aspects;
+	// Covers drawn in the last frame, reused so painting doesn't allocate
+	std::vector<layout::Cover> visible;
 	int index;
 	float animatingIndex;
 	ImagePool pool;
+	NavigationTracker navigation;
+	ThumbnailPack thumbnails;
 	Animator<float> animator;
 	std::atomic_bool workInBackground;
-	std::future<void> loader;
+	std::vector<std::future<void>> loaders;
+
+	// Comics scanned by the loaders, each published as soon as it is done
+	std::mutex ingestLock;
+	std::deque<std::filesystem::path> ingestQueue;
+	std::vector<Comic> ingested;
+	size_t ingestTotal;		// Queued since the loaders last went idle
+	size_t ingestFinished;
+	unsigned int activeLoaders;
 
 	void OnComicAddition(wxCommandEvent& evt);
+	void OnImageReady(wxCommandEvent& evt);
 	void OnPaint(wxPaintEvent& evt);
 	void OnSize(wxSizeEvent& event);
 	bool AddComic(std::filesystem::path path);
+	std::optional<Comic> ScanComic(const std::filesystem::path& path);
+	// Returns the position the comic was inserted at, it replaces one
+	// published before from the same path
+	int PublishComic(Comic comic);
+	void RemoveComic(const std::filesystem::path& path);
+	void IngestComics();
+	void PublishComics();
+	void StopLoading();
 
-	void verify(const wxGraphicsContext* g, int index);
+	// Queue `paths` for the loaders, in order, starting more if needed
+	void ingest(
+		const std::vector<std::filesystem::path>& paths, unsigned int workers);
+	// Sorted and deduplicated, then ordered outward from the comic in view
+	std::vector<std::filesystem::path> nearestFirst(
+		std::vector<std::filesystem::path> paths) const;
+	void updateAspect(int index);
+	void prefetch(int from, int to);
 
    public:
 	ComicGallery(
 		wxWindow* parent, const std::vector<std::filesystem::path>& paths);
 	~ComicGallery();
-	void loadComics(std::vector<std::filesystem::path> paths);
+	// Scan comics on `workers` threads, 0 uses one per hardware thread.
+	// Comics next to the one in view are scanned first.
+	void loadComics(
+		std::vector<std::filesystem::path> paths, unsigned int workers = 0);
+	// Scan and publish `added`, replacing comics from the same paths, and
+	// drop `removed`. Every other comic is left as it is.
+	void changeComics(
+		std::vector<std::filesystem::path> added,
+		const std::vector<std::filesystem::path>& removed);
 	void HandleInput(Navigation input, char ch = ' ');
-	Comic& currentComic() { return comics[index]; }
+	Comic& currentComic() { return *comics[index]; }
 	int length() const;
 };
@@ -5,10 +5,13 @@
 
 #include <filesystem>
 #include <functional>
+#include <memory>
 
 #include "animator.hpp"
 #include "comic.hpp"
 #include "image_utils.hpp"
+#include "page_pipeline.hpp"
+#include "prefetcher.hpp"
 #include "viewport.hpp"
 
 enum Navigation {
@@ -31,9 +34,17 @@ enum AnimationType { None, Pan, View };
 class ComicViewer : public wxPanel {
 	Comic& comic;
 	int index;
+	// Show the end of the page once its size is known, after moving back
+	bool showEnd;
 	AnimationType animation;
 
 	ImagePool pool;
+	// Pool image of each page. Streamed pages are sorted into reading order
+	// as they arrive but stay where they were added to the pool.
+	std::vector<int> slots;
+	NavigationTracker navigation;
+	// Reads archives that can't be indexed cheaply, until it is done
+	std::unique_ptr<PagePipeline> pipeline;
 
 	wxPoint2DDouble inProgressPanVector;
 	wxPoint2DDouble inProgressPanStartPoint;
@@ -42,6 +53,19 @@ class ComicViewer : public wxPanel {
 
 	Viewport viewport;
 
+	// The page as last composed, without the overlay. While panning it is
+	// shifted and only the uncovered strips are drawn.
+	wxBitmap backBuffer, scrollBuffer;
+	wxPoint2DDouble bufferPan;	// Viewport position the buffer shows
+	double bufferZoom;
+	int bufferIndex;
+	bool bufferValid;  // Composed from the ready page
+	// The shown page's bitmap converted for the renderer, redone only when
+	// the pool hands out a different bitmap
+	wxGraphicsBitmap pageBitmap;
+	wxBitmap pageBitmapSource;
+	int pageBitmapSlot;
+
 	void OnPaint(wxPaintEvent&);
 	void OnMouseWheel(wxMouseEvent&);
 	void OnLeftDown(wxMouseEvent&);
@@ -51,11 +75,28 @@ class ComicViewer : public wxPanel {
 	void OnSize(wxSizeEvent&);
 	void OnCaptureLost(wxMouseCaptureLostEvent&);
 	void OnClose(wxCloseEvent&);
+	void OnImageReady(wxCommandEvent&);
+	void OnPagesStreamed(wxCommandEvent&);
+	void addPages();
+	// Reads page `i` through the comic's shared reader
+	std::function<std::vector<uint8_t>()> pageReader(int i);
+	// Prefetches around `to` in the pool's indices
+	void prefetch(int from, int to);
+	// Draws the page into `buffer` within `area`, in client pixels, with
+	// the viewport moved to `pan`
+	void DrawPage(
+		wxBitmap& buffer, const wxPoint2DDouble& pan, bool ready,
+		const wxRegion& area, wxInterpolationQuality quality);
+	void ScrollBuffer(const wxPoint2DDouble& pan);
+	const wxGraphicsBitmap& PageBitmap(wxGraphicsContext* gc);
 
 	void StartPan(const wxPoint2DDouble&, PanSource);
 	void ProcessPan(const wxPoint2DDouble&, bool, PanSource);
 	void FinishPan(bool refresh, PanSource);
 
+	// Size of page `i` without decoding it. Until it is known the page is
+	// laid out as if it filled the window at the current zoom.
+	wxSize pageSize(int i);
 	std::pair<Navigation, wxPoint2DDouble> ComputeMove(Navigation direction);
 	void OptimizeViewport();
 	wxPoint2DDouble MapClientToViewport(const wxPoint&);
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <wx/event.h>
+#include <wx/timer.h>
+
+#include <chrono>
+#include <functional>
+#include <map>
+
+// One timer at the display's refresh rate stepping every running animation,
+// so that animations refresh at most once per frame, all in the same tick.
+// The timer only runs while something is subscribed.
+class FrameClock : public wxEvtHandler {
+   public:
+	using Tick = std::function<void(std::chrono::steady_clock::time_point)>;
+
+   private:
+	wxTimer timer;
+	std::map<int, Tick> ticks;
+	int nextId;
+	int intervalMs;
+
+	void OnTimer(wxTimerEvent& event);
+
+   public:
+	FrameClock(int intervalMs);
+	// At the display's refresh rate, capped by COMIC_READER_FPS
+	static FrameClock& get();
+
+	int interval() const { return intervalMs; }
+	// `tick` runs on the UI thread every frame until removed, it may add
+	// or remove subscribers, itself included
+	int add(Tick tick);
+	void remove(int id);
+};
+
+// Milliseconds between frames at `refreshRate` Hz, 60 if it is unknown.
+// `override` caps the rate in frames per second.
+int frameInterval(const char* override, int refreshRate);
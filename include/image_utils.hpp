@@ -1,10 +1,63 @@
 #pragma once
 
 #include <wx/bitmap.h>
+#include <wx/event.h>
+#include <wx/geometry.h>
+#include <wx/image.h>
 
+#include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "lru.hpp"
+#include "prefetcher.hpp"
+#include "tile_source.hpp"
+
+// Encoded cover thumbnail, `extension` tells how `content` is encoded
+struct Thumbnail {
+	int width = 0;
+	int height = 0;
+	std::string extension;
+	std::vector<uint8_t> content;
+};
+
+// Decode an image held in memory, `file` is only used for its extension
+wxImage loadImage(
+	const uint8_t* data, size_t size, const std::filesystem::path& file);
+
+// Decode an image file, WebP files are mapped and decoded in place
+wxImage loadImage(const std::filesystem::path& file);
+
+// High quality resize with the SIMD resampler, alpha included
+wxImage resizeImage(const wxImage& image, int width, int height);
+
+enum class ThumbnailCodec {
+	Original,  // Format of the cover, WebP covers are encoded losslessly
+	WebP,	   // Lossy WebP
+	Raw		   // Unencoded RGB, fastest to write and read but largest
+};
+
+// How resized covers are encoded, the codec ends up in the extension
+struct ThumbnailFormat {
+	ThumbnailCodec codec = ThumbnailCodec::WebP;
+	int quality = 80;  // WebP quality, 0 to 100
+	int method = 0;	   // WebP effort, 0 (fastest) to 6
+};
+
+// Parses "webp[:quality[:method]]", "raw" or "original", anything else
+// gives the default
+ThumbnailFormat thumbnailFormat(const char* spec);
+
+Thumbnail makeThumbnail(
+	const std::vector<uint8_t>& content, const std::filesystem::path& name,
+	const int MAX_DIM, const ThumbnailFormat& format = ThumbnailFormat());
 
 bool saveThumbnail(
 	const std::filesystem::path& src, const std::filesystem::path& dest,
@@ -12,19 +65,122 @@ bool saveThumbnail(
 
 bool isImage(const std::filesystem::path& file);
 
+// Id of the wxEVT_COMMAND_TEXT_UPDATED event an ImagePool posts to its owner
+// when a requested image has been decoded
+const int IMAGE_POOL_UPDATE_ID = 100001;
+
+// Image decoded at 1/2^level of its native `size`
+struct DecodedImage {
+	wxImage image;
+	wxSize size;
+	int level = 0;
+};
+
+// Levels go down to 1/8, the smallest JPEG DCT scaling
+const int MAX_DECODE_LEVEL = 3;
+
+// Decode `content`, reduced by 2^level when the format allows it cheaply.
+// `name` is only used for its extension.
+DecodedImage decodeImage(
+	const uint8_t* data, size_t size, const std::filesystem::path& name,
+	int level = 0);
+DecodedImage decodeImage(
+	const std::vector<uint8_t>& content, const std::filesystem::path& name,
+	int level = 0);
+
 class ImagePool {
+	// Decoded off the UI thread, waiting to become bitmaps
+	struct Prepared {
+		DecodedImage decoded;
+		std::shared_ptr<TileSource> tiles;	// Instead of decoded.image
+	};
+
 	std::vector<std::filesystem::path> paths;
+	std::vector<std::function<std::vector<uint8_t>()>> readers;
 	std::vector<wxBitmap> bitmaps;
-	LRU<int, unsigned long long> lru;
+	// Large images have a source and their tiles instead of a bitmap
+	std::vector<std::shared_ptr<TileSource>> tileSources;
+	std::vector<std::vector<wxBitmap>> tiles;
+	std::vector<int> levels;  // Of each bitmap
+	std::vector<wxSize> sizes;
+	LRU<uint64_t, unsigned long long> lru;	// Keyed by lruKey()
+	wxEvtHandler* owner;
+	int budgetId;  // In MemoryBudget, -1 while not registered
+
+	// Guards the sources and prefetched images against the prefetcher
+	std::mutex sourceLock;
+	std::unordered_map<int, Prepared> prefetched;
+	int level;	// Coarsest level that still looks sharp at the display scale
+	// Images waiting to be shown and the ones that failed to decode
+	std::unordered_set<int> requested;
+	std::unordered_set<int> failed;
+	unsigned long long prefetchBudget;
+	unsigned int workers;
+	// Last member, so it is stopped before anything it uses goes away
+	std::unique_ptr<Prefetcher> prefetcher;
 
 	void load(int index);
+	Prepared prepare(DecodedImage decoded) const;
+	void adopt(int index, Prepared prepared);
+	bool loaded(int index) const;
+	// Shown at least as sharp as the display scale needs
+	bool sharp(int index) const;
 	void unload(int index);
+	void unloadTile(int index, int tile);
+	void dropTiles(int index);
+	void prefetch(int index);
+	void startPrefetcher();
+	// Whatever the LRU and the prefetched images leave of the budget,
+	// sourceLock must be held
+	void updatePrefetchBudget();
+	void joinBudget();
+	void leaveBudget();
 
    public:
-	ImagePool();
+	// `owner` gets an IMAGE_POOL_UPDATE_ID event for every finished request.
+	// Images are decoded on `workers` threads, 0 picks from the core count.
+	ImagePool(wxEvtHandler* owner = nullptr, unsigned int workers = 0);
+	~ImagePool();
+	// Give this pool the larger share of the MemoryBudget
+	void activate();
 	bool addImage(const std::filesystem::path& filepath);
+	// Decode the content returned by `reader` when the image is needed,
+	// `name` is only used for its extension. A known `size` lets size()
+	// answer without decoding.
+	bool addImage(
+		const std::filesystem::path& name,
+		std::function<std::vector<uint8_t>()> reader,
+		const wxSize& size = wxDefaultSize);
+	// Decode the image from `reader` from now on, its content must not
+	// change
+	void setReader(int index, std::function<std::vector<uint8_t>()> reader);
+	// Native size, wxDefaultSize until it is known. Never decodes, an
+	// unknown image is requested instead.
 	const wxSize size(int index);
+	// Size if known without decoding, wxDefaultSize otherwise
+	const wxSize& knownSize(int index) const { return sizes[index]; }
+	// Possibly decoded below native size, draw it scaled to size(). Empty
+	// for tiled images, and until request() is true, which bitmap() calls.
 	const wxBitmap& bitmap(int index);
+	// Whether the image is drawn from tilesIn() instead of bitmap()
+	bool tiled(int index) const { return tileSources[index] != nullptr; }
+	// Tiles of a tiled image crossing `area`, both in native pixels
+	std::vector<std::pair<wxRect2DDouble, wxBitmap>> tilesIn(
+		int index, const wxRect2DDouble& area);
+	// Non blocking, true once bitmap() has something to return.
+	// Otherwise, or when the bitmap is coarser than the display scale
+	// needs, the image is decoded in the background ahead of any prefetch
+	// and the owner is notified when it is ready.
+	bool request(int index);
+	// Scale the images are drawn at, decodes are reduced to match it
+	void setScale(double scale);
 	auto empty() const { return paths.empty() || bitmaps.empty(); }
+	// Hand over an image decoded elsewhere, it is kept like a shown one
+	// until the LRU evicts it. UI thread only.
+	void offer(int index, DecodedImage decoded);
+	// Decode (index, priority) pairs in the background, spread over the
+	// workers, replacing whatever was scheduled before
+	void prefetch(const std::vector<std::pair<int, int>>& indices);
+	void cancelPrefetch();
 	void clear();
 };
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+
+// Where the gallery and the viewer draw things, kept apart from wx so that
+// it can be tested and benchmarked without a display
+namespace layout {
+	struct Point {
+		double x = 0;
+		double y = 0;
+	};
+
+	struct Size {
+		double width = 0;
+		double height = 0;
+	};
+
+	struct Rect {
+		double x = 0;
+		double y = 0;
+		double width = 0;
+		double height = 0;
+
+		double right() const { return x + width; }
+		double bottom() const { return y + height; }
+		Point centre() const { return {x + width / 2, y + height / 2}; }
+		// Scaled by `scale` keeping `point` in place
+		Rect scaledAt(const Point& point, double scale) const;
+	};
+
+	struct Cover {
+		int index;
+		Rect rect;
+	};
+
+	// Covers with the width over height ratios `aspects` that reach an
+	// `area` wide screen, around `position`. A fractional position slides
+	// from one cover to the next. `covers` is reused to not allocate, the
+	// focused cover comes last so that it is drawn on top.
+	void coverFlow(
+		const std::vector<double>& aspects, double position, const Size& area,
+		std::vector<Cover>& covers);
+
+	// The viewer shows the part `viewport` of a page, both in page pixels
+
+	// Zoom after `zoom` out of fit to width, fit to height and native size,
+	// wrapping around to the smallest
+	double nextZoom(double zoom, const Size& client, const Size& page);
+
+	// `viewport` shrunk if it shows space around the page on both sides,
+	// then moved over the page or centred where the page is smaller
+	Rect fitViewport(const Rect& viewport, const Size& page);
+
+	// Step through the page in reading order, either by panning `delta`
+	// or to the adjacent page (`page` is 1 or -1) once at the end
+	struct Move {
+		int page;
+		Point delta;
+	};
+	Move nextView(const Rect& viewport, const Size& page);
+	Move previousView(const Rect& viewport, const Size& page);
+
+	// Where the whole page is drawn in the client area
+	Rect pageRect(const Rect& viewport, const Size& client, const Size& page);
+}  // namespace layout
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+bool isComic(const std::filesystem::path& file);
+
+// Comic archives anywhere below `roots`, in no particular order. Directories
+// are walked on `workers` threads, 0 uses one per hardware thread. Every
+// directory visited is passed to `visit` if given, from the walking thread.
+std::vector<std::filesystem::path> findComics(
+	const std::vector<std::filesystem::path>& roots, unsigned int workers = 0,
+	const std::function<void(const std::filesystem::path&)>& visit = nullptr);
+
+// Comics that appeared or disappeared on disk. Rewritten comics count as
+// added again.
+struct LibraryChange {
+	std::set<std::filesystem::path> added;
+	std::set<std::filesystem::path> removed;
+
+	bool empty() const { return added.empty() && removed.empty(); }
+	// Folds in a change that happened after this one
+	void merge(const LibraryChange& later);
+};
+
+// Root directories remembered across runs and the comics found below them.
+// Once watching, the comic set follows changes on disk without rescanning
+// (inotify on Linux, elsewhere only new roots and scan() are picked up).
+class Library {
+	std::filesystem::path rootsFile;
+
+	mutable std::mutex lock;
+	std::vector<std::filesystem::path> rootDirs;
+	// Added while watching, not walked yet
+	std::vector<std::filesystem::path> pendingRoots;
+	std::set<std::filesystem::path> archives;
+	// Changes to archives not reported yet
+	LibraryChange pending;
+
+	std::function<void(const LibraryChange&)> changed;
+	std::atomic_bool stopping;
+	int notifier;  // inotify descriptor, -1 when not watching
+	std::unordered_map<int, std::filesystem::path> watches;
+	std::thread watcher;
+
+	void saveRoots() const;
+	void addWatch(const std::filesystem::path& dir);
+	void addTree(const std::filesystem::path& dir);
+	void removeTree(const std::filesystem::path& dir);
+	// Both with the lock held
+	void addArchive(const std::filesystem::path& path);
+	void removeArchive(const std::filesystem::path& path);
+	// Applies pending notifications
+	void readEvents();
+	void report();
+	void watch();
+
+   public:
+	// Roots are read from and saved to `rootsFile`
+	Library(const std::filesystem::path& rootsFile);
+	~Library();
+	Library(const Library&) = delete;
+	Library& operator=(const Library&) = delete;
+
+	std::vector<std::filesystem::path> roots() const;
+	// Remembers `dir`, false if it was known. The comics below it are added
+	// by the watcher, or by the next scan() when not watching.
+	bool addRoot(const std::filesystem::path& dir);
+	// Rescans every root from scratch
+	void scan(unsigned int workers = 0);
+	std::vector<std::filesystem::path> comics() const;
+	// Scans and then follows changes on disk, both on a background thread.
+	// `onChange` runs on that thread with every comic once the scan is done,
+	// then with what changed after each batch of changes to the comic set.
+	void startWatching(std::function<void(const LibraryChange&)> onChange);
+	void stopWatching();
+};
@@ -1,45 +1,164 @@
+#include <cstdint>
 #include <functional>
-#include <list>
-#include <unordered_map>
+#include <vector>
 
+// Entries live in a flat slot array chained into a list by index and are
+// found through an open addressing table of slot indices. Freed slots are
+// reused, so hits allocate nothing once the cache has reached its size.
 template <typename K, typename W> class LRU {
-	std::list<std::pair<K, W>> hits;
-	std::unordered_map<K, typename std::list<std::pair<K, W>>::iterator>
-		positions;
+	static constexpr uint32_t NIL = UINT32_MAX;
+
+	struct Slot {
+		K key;
+		W weight;
+		uint32_t prev;
+		uint32_t next;
+	};
+
+	std::vector<Slot> slots;
+	std::vector<uint32_t> table;  // Slot of each bucket, NIL if empty
+	uint32_t head, tail;		  // Least and most recently used
+	uint32_t freeSlots;			  // Chained through Slot::next
+	uint32_t count;
 	W currentWeight;
 	W maxWeight;
 	unsigned int minCount;
-	std::list<std::function<void(K)>> evictionHooks;
+	std::vector<std::function<void(K)>> evictionHooks;
+
+	size_t home(const K& key) const {
+		// Fibonacci hashing, std::hash is the identity for integers
+		const uint64_t h = std::hash<K>{}(key) * 0x9E3779B97F4A7C15ull;
+		return static_cast<size_t>(h >> 32) & (table.size() - 1);
+	}
+
+	// Bucket holding `key`, or the empty one it would go in
+	size_t find(const K& key) const {
+		const auto mask = table.size() - 1;
+		auto b = home(key);
+		while (table[b] != NIL && !(slots[table[b]].key == key)) {
+			b = (b + 1) & mask;
+		}
+		return b;
+	}
+
+	// Backward shift deletion, keeps probe sequences intact without
+	// tombstones
+	void erase(size_t b) {
+		const auto mask = table.size() - 1;
+		for (auto n = (b + 1) & mask; table[n] != NIL; n = (n + 1) & mask) {
+			const auto h = home(slots[table[n]].key);
+			if (((n - h) & mask) >= ((n - b) & mask)) {
+				table[b] = table[n];
+				b = n;
+			}
+		}
+		table[b] = NIL;
+	}
+
+	void grow() {
+		table.assign(table.size() * 2, NIL);
+		for (auto i = head; i != NIL; i = slots[i].next) {
+			table[find(slots[i].key)] = i;
+		}
+	}
+
+	void unlink(uint32_t i) {
+		auto& slot = slots[i];
+		(slot.prev == NIL ? head : slots[slot.prev].next) = slot.next;
+		(slot.next == NIL ? tail : slots[slot.next].prev) = slot.prev;
+	}
+
+	void append(uint32_t i) {
+		slots[i].prev = tail;
+		slots[i].next = NIL;
+		(tail == NIL ? head : slots[tail].next) = i;
+		tail = i;
+	}
 
 	void trim() {
-		while (hits.size() > minCount && currentWeight > maxWeight) {
-			auto del = hits.front();
-			hits.pop_front();
-			positions.erase(del.first);
+		while (count > minCount && currentWeight > maxWeight) {
+			const auto key = slots[head].key;
+			remove(key);
 			for (auto& hook : evictionHooks) {
-				if (hook) { hook(del.first); }
+				if (hook) { hook(key); }
 			}
-			currentWeight -= del.second;
 		}
 	}
 
    public:
 	LRU(W maxW, unsigned int minC)
-		: currentWeight(0), maxWeight(maxW), minCount(minC) {}
+		: table(16, NIL),
+		  head(NIL),
+		  tail(NIL),
+		  freeSlots(NIL),
+		  count(0),
+		  currentWeight(0),
+		  maxWeight(maxW),
+		  minCount(minC) {}
+
+	W weight() const { return currentWeight; }
+	W capacity() const { return maxWeight; }
+
+	// Evicts right away if the new capacity is exceeded
+	void setCapacity(W maxW) {
+		maxWeight = maxW;
+		trim();
+	}
+
+	// Forgets `key` without calling the eviction hooks
+	void remove(const K& key) {
+		const auto b = find(key);
+		if (table[b] == NIL) { return; }
+		const auto i = table[b];
+		currentWeight -= slots[i].weight;
+		erase(b);
+		unlink(i);
+		slots[i].next = freeSlots;
+		freeSlots = i;
+		--count;
+	}
+
+	// Forgets every entry without calling the eviction hooks
+	void clear() {
+		slots.clear();
+		table.assign(table.size(), NIL);
+		head = tail = freeSlots = NIL;
+		count = 0;
+		currentWeight = 0;
+	}
 
 	void addEvictionHook(std::function<void(K)> func) {
 		evictionHooks.push_back(func);
 	}
 
 	void hit(K key, W weight = 1) {
-		auto it = positions.find(key);
-		if (it != positions.end()) {
-			currentWeight -= it->second->second;
-			hits.erase(it->second);
+		auto b = find(key);
+		if (table[b] != NIL) {
+			const auto i = table[b];
+			currentWeight -= slots[i].weight;
+			slots[i].weight = weight;
+			unlink(i);
+			append(i);
+		} else {
+			// Keep the table at most half full so probes stay short
+			if ((count + 1) * 2 > table.size()) {
+				grow();
+				b = find(key);
+			}
+			auto i = freeSlots;
+			if (i != NIL) {
+				freeSlots = slots[i].next;
+				slots[i].key = key;
+				slots[i].weight = weight;
+			} else {
+				i = static_cast<uint32_t>(slots.size());
+				slots.push_back({key, weight, NIL, NIL});
+			}
+			table[b] = i;
+			append(i);
+			++count;
 		}
 		currentWeight += weight;
-		hits.emplace_back(key, weight);
-		positions[key] = std::prev(std::end(hits));
 		trim();
 	}
 };
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// Read-only memory mapping of a whole file, or of anonymous memory
+class MappedFile {
+	const uint8_t* ptr;
+	size_t length;
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#endif
+
+   public:
+	MappedFile();
+	MappedFile(const std::filesystem::path& filePath);
+	// Anonymous mapping holding a copy of `data`, backed by swap or the
+	// page file instead of a file on disk
+	static MappedFile copyOf(const uint8_t* data, size_t size);
+	~MappedFile();
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const uint8_t* data() const { return ptr; }
+	size_t size() const { return length; }
+	void close();
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <mutex>
+
+// Process wide cap on decoded image memory, split between the registered
+// pools. The active pool gets most of it, the rest keep a small share.
+class MemoryBudget {
+	struct Pool {
+		std::function<void(unsigned long long)> resize;
+		unsigned long long bytes = 0;
+	};
+
+	std::mutex lock;
+	unsigned long long totalBytes;
+	std::map<int, Pool> pools;
+	int nextId;
+	int activeId;
+
+	void rebalance();
+
+   public:
+	// Share of the budget given to the active pool when there are others
+	static constexpr double ACTIVE_SHARE = 0.75;
+
+	MemoryBudget(unsigned long long totalBytes);
+	// Sized from COMIC_READER_MEMORY_MB, or a fraction of physical memory
+	static MemoryBudget& get();
+
+	unsigned long long total() const { return totalBytes; }
+	void setTotal(unsigned long long bytes);
+	// `resize` is called with the pool's share now and whenever it changes
+	int add(std::function<void(unsigned long long)> resize);
+	void remove(int id);
+	void activate(int id);
+};
+
+// `override` is a size in MB, otherwise an eighth of `physicalBytes` is used
+unsigned long long defaultMemoryBudget(
+	const char* override, unsigned long long physicalBytes);
+
+// Installed memory, 0 if unknown
+unsigned long long physicalMemory();
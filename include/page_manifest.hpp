@@ -0,0 +1,31 @@
+#pragma once
+
+#include <wx/gdicmn.h>
+
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+#include "archive.hpp"
+
+// Reading order of pages, the natural order of their paths
+bool pageOrder(const std::filesystem::path& a, const std::filesystem::path& b);
+
+// Cached result of indexing an archive: its entries, the image entries in
+// reading order and the decoded size of every page seen so far. A manifest
+// is only loaded back while the archive's size and mtime are unchanged.
+struct PageManifest {
+	ArchiveStamp stamp;
+	bool seekable;
+	std::vector<ArchiveEntry> entries;
+	std::vector<uint32_t> pages;  // Indices into entries
+	std::vector<wxSize> sizes;	  // wxDefaultSize until decoded once
+
+	static PageManifest build(const ArchiveIndex& index);
+	static std::optional<PageManifest> load(
+		const std::filesystem::path& archivePath,
+		const std::filesystem::path& manifestPath);
+	void save(
+		const std::filesystem::path& archivePath,
+		const std::filesystem::path& manifestPath) const;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "archive.hpp"
+#include "image_utils.hpp"
+
+struct StreamedPage {
+	ArchiveEntry entry;
+	DecodedImage decoded;  // Empty if the page couldn't be decoded
+};
+
+// Decodes the content of the image file `name`
+using PageDecoder = std::function<DecodedImage(
+	const std::vector<uint8_t>& content, const std::filesystem::path& name)>;
+
+// Reads an archive front to back on one thread, the only cheap way through
+// solid archives, and decodes its images on `workers` others. At most
+// `depth` pages are held between the stages, decoding ones included, so
+// memory doesn't grow with the archive.
+class PagePipeline {
+	struct Extracted {
+		size_t order;
+		ArchiveEntry entry;
+		std::vector<uint8_t> content;
+	};
+
+	std::filesystem::path archivePath;
+	size_t depth;
+	std::function<void()> ready;
+	PageDecoder decoder;
+
+	std::mutex lock;
+	std::condition_variable space;	// For the extractor
+	std::condition_variable work;	// For the decoders
+	std::deque<Extracted> extracted;
+	std::map<size_t, StreamedPage> decoded;	 // By archive order
+	size_t decoding;  // Taken by a decoder, not in `decoded` yet
+	size_t extractedCount;
+	size_t takenCount;
+	std::vector<ArchiveEntry> entries;
+	bool extracting;
+	bool stopping;
+
+	std::thread extractor;
+	std::vector<std::thread> decoders;
+
+	void extract();
+	void decode();
+
+   public:
+	// `ready` runs on a pipeline thread whenever pages can be taken, and
+	// once more when the archive has been read through. Pages are decoded
+	// with `decoder`, decodeImage() if it is empty.
+	PagePipeline(
+		const std::filesystem::path& archivePath, std::function<void()> ready,
+		unsigned int workers = 0, size_t depth = 4,
+		PageDecoder decoder = nullptr);
+	~PagePipeline();
+	PagePipeline(const PagePipeline&) = delete;
+	PagePipeline& operator=(const PagePipeline&) = delete;
+
+	// Decoded pages next in archive order
+	std::vector<StreamedPage> take();
+	// Whether every page has been decoded and taken
+	bool done();
+	// Every regular file in the archive, complete once done()
+	std::vector<ArchiveEntry> files();
+};
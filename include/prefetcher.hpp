@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Runs `job` for scheduled indices on a fixed set of background threads,
+// highest priority first. Jobs that haven't started yet can be dropped with
+// cancel().
+class Prefetcher {
+	std::function<void(int)> job;
+	std::vector<std::pair<int, int>> queue;	 // (priority, index)
+	// Indices being worked on, an index never runs on two workers at once
+	std::unordered_set<int> running;
+	std::mutex lock;
+	std::condition_variable wake;
+	bool stopping;
+	std::vector<std::thread> workers;
+
+	void run();
+
+   public:
+	// `job` must be safe to run for different indices at the same time
+	// when there is more than one worker
+	Prefetcher(std::function<void(int)> job, unsigned int workers = 1);
+	~Prefetcher();
+	Prefetcher(const Prefetcher&) = delete;
+	Prefetcher& operator=(const Prefetcher&) = delete;
+
+	void schedule(int index, int priority);
+	void cancel();
+};
+
+// Predicts the indices needed next from the direction and speed of recent
+// navigation. Forward reading looks 2 pages ahead, 3 when paging quickly;
+// a backward jump looks behind the new position as well.
+class NavigationTracker {
+	using Clock = std::chrono::steady_clock;
+
+	Clock::time_point lastMove;
+	double pagesPerSecond;
+	int direction;
+
+   public:
+	NavigationTracker();
+
+	// Indices around `to` with their priorities, excluding `to` itself
+	std::vector<std::pair<int, int>> onNavigate(
+		int from, int to, int count, Clock::time_point now = Clock::now());
+};
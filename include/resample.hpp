@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+enum class ResampleFilter {
+	Box,	  // Area average, for large reductions
+	Lanczos3  // Sharpest, for the final step to the target size
+};
+
+enum class ResampleKernel { Auto, Scalar, SSE2, AVX2 };
+
+// Whether `kernel` can run on this CPU, Auto always can
+bool resampleKernelSupported(ResampleKernel kernel);
+
+// Separable resize of 8 bit images with `channels` interleaved channels
+// (1, 3 or 4) and tightly packed rows. Auto picks the widest kernel the CPU
+// supports at runtime, every kernel gives the same result.
+void resample(
+	const uint8_t* src, int srcWidth, int srcHeight, uint8_t* dst,
+	int dstWidth, int dstHeight, int channels, ResampleFilter filter,
+	ResampleKernel kernel = ResampleKernel::Auto);
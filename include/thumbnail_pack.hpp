@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "image_utils.hpp"
+#include "mapped_file.hpp"
+
+struct ThumbnailEntry {
+	int64_t archiveSize;
+	int64_t archiveTime;
+	int pages;	// 0 for archives without any image
+	int width;
+	int height;
+	std::string extension;
+	uint64_t offset;
+	uint64_t length;
+};
+
+// Append-only file of cover thumbnails that persists across sessions.
+// Entries are keyed by archive path and are only valid as long as the
+// archive's size and modification time are unchanged. Replaced records
+// stay in the file until it is compacted, which opening the pack does
+// once they outweigh the live ones.
+class ThumbnailPack {
+	std::filesystem::path packPath;
+	MappedFile mapping;
+	std::unordered_map<std::string, ThumbnailEntry> entries;
+	uint64_t validEnd;	 // End of the last complete record
+	uint64_t liveBytes;	 // Size of the records in entries
+	bool enabled;
+	std::mutex lock;
+
+	void create();
+	void scan();
+	void compactLocked();
+
+   public:
+	ThumbnailPack(const std::filesystem::path& packPath);
+
+	std::optional<ThumbnailEntry> find(const std::filesystem::path& archive);
+	// Returns false if the thumbnail couldn't be stored
+	bool add(
+		const std::filesystem::path& archive, int pages,
+		const Thumbnail& thumbnail);
+	std::vector<uint8_t> read(const std::filesystem::path& archive);
+	// Rewrites the pack with only the entries of unchanged archives
+	void compact();
+};
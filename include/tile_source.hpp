@@ -0,0 +1,34 @@
+#pragma once
+
+#include <wx/image.h>
+
+#include "mapped_file.hpp"
+
+// Images with more pixels, or a longer side, are split into tiles
+const long long TILE_THRESHOLD_PIXELS = 1 << 24;
+const int TILE_THRESHOLD_SIDE = 8192;
+// Pixels in each tile, about 3 MB of RGB
+const int TILE_PIXELS = 1 << 20;
+
+bool needsTiles(const wxSize& size);
+
+// Decoded pixels of an image too large to keep as one bitmap. The rows are
+// kept in an anonymous mapping the system can page out, only the tiles
+// being shown are copied out. Tiles are strips of whole rows, which keeps
+// each one contiguous and suits tall pages.
+class TileSource {
+	MappedFile pixels;
+	wxSize size;
+	int tileHeight;
+
+   public:
+	TileSource(const wxImage& image);
+	TileSource(const TileSource&) = delete;
+	TileSource& operator=(const TileSource&) = delete;
+
+	const wxSize& imageSize() const { return size; }
+	int count() const;
+	// Area of the image covered by `tile`
+	wxRect rect(int tile) const;
+	wxImage read(int tile) const;
+};
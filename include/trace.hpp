@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+
+// Timed spans saved as a Chrome trace, which chrome://tracing and
+// ui.perfetto.dev can open. Every thread records into its own ring buffer,
+// allocated the first time it records, so while tracing is off a span costs
+// one relaxed load.
+class Trace {
+	static std::atomic_bool on;
+
+   public:
+	// Events kept per thread, older ones are overwritten
+	static constexpr size_t BUFFER_EVENTS = 1 << 15;
+
+	static bool enabled() { return on.load(std::memory_order_relaxed); }
+	// Starts recording, dropping whatever was recorded before
+	static void start();
+	// Stops recording and saves what was recorded, false if `file` couldn't
+	// be written
+	static bool stop(const std::filesystem::path& file);
+	// Nanoseconds on a steady clock
+	static int64_t now();
+	// `name` has to outlive the trace, string literals do
+	static void record(const char* name, int64_t begin, int64_t end);
+	// A key press, the next frame to finish closes its input to frame span
+	static void input();
+	static void frame(int64_t end);
+};
+
+// Records its lifetime as a span named `name`, if tracing was on when it
+// started
+class TraceSpan {
+	const char* name;
+	int64_t begin;
+	bool isFrame;
+
+   public:
+	// A `frame` span ends with the frame on screen, declare it before the
+	// paint DC so that its blit is included
+	TraceSpan(const char* name, bool frame = false)
+		: name(Trace::enabled() ? name : nullptr),
+		  begin(this->name ? Trace::now() : 0),
+		  isFrame(frame) {}
+	~TraceSpan() {
+		if (!name) { return; }
+		const auto end = Trace::now();
+		Trace::record(name, begin, end);
+		if (isFrame) { Trace::frame(end); }
+	}
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan& operator=(const TraceSpan&) = delete;
+};
@@ -8,3 +8,8 @@ double drawWrappedText(
 
 void drawBottomText(
 	std::string text, wxGraphicsContext* gc, const int cw, const int ch);
+
+// Stands in for an image that is still being decoded
+void drawPlaceholder(
+	wxGraphicsContext* gc, const double x, const double y, const double w,
+	const double h);
@@ -2,12 +2,16 @@
 
 #include <wx/mimetype.h>
 
+#include <algorithm>
 #include <array>
 #include <filesystem>
 #include <fstream>
 #include <memory>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
+#include "trace.hpp"
 #include "util.hpp"
 
 ArchiveFile::ArchiveFile(struct archive* ap, archive_entry* e)
@@ -20,6 +24,9 @@ std::filesystem::path ArchiveFile::path() const {
 }
 
 int64_t ArchiveFile::size() const { return archive_entry_size(entry); }
+int64_t ArchiveFile::offset() const {
+	return archive_read_header_position(archivePtr);
+}
 int ArchiveFile::type() const { return archive_entry_filetype(entry); }
 bool ArchiveFile::isFile() const { return type() == AE_IFREG; }
 
@@ -44,25 +51,54 @@ void ArchiveFile::writeContent(const std::filesystem::path& filePath) const {
 	}
 }
 
-void processArchiveFile(
-	const std::filesystem::path& filePath,
-	std::function<void(const ArchiveFile&)> func) {
+std::vector<uint8_t> ArchiveFile::readContent() const {
+	TraceSpan span("ArchiveFile::readContent");
+	std::vector<uint8_t> content;
+	if (archive_entry_size_is_set(entry)) { content.reserve(size()); }
+
+	const auto length = 8192;
+	std::array<uint8_t, length> buffer;
+	auto len = archive_read_data(archivePtr, buffer.data(), length);
+	while (len > 0) {
+		content.insert(content.end(), buffer.begin(), buffer.begin() + len);
+		len = archive_read_data(archivePtr, buffer.data(), length);
+	}
+	if (len < 0) {
+		throw std::filesystem::filesystem_error(
+			"Unable to read file from archive", path(),
+			std::make_error_code(std::errc::io_error));
+	}
+	return content;
+}
+
+struct archive* openArchive(const std::filesystem::path& filePath) {
 	auto archive = archive_read_new();
 	if (archive == nullptr) {
 		throw std::invalid_argument("Couldn't create archive reader");
 	}
 	if (archive_read_support_filter_all(archive) != ARCHIVE_OK) {
+		archive_read_free(archive);
 		throw std::invalid_argument("Couldn't enable decompression");
 	}
 	if (archive_read_support_format_all(archive) != ARCHIVE_OK) {
+		archive_read_free(archive);
 		throw std::invalid_argument("Couldn't enable read formats");
 	}
 	if (archive_read_open_filename(archive, filePath.string().c_str(), 0) !=
 		ARCHIVE_OK) {
+		archive_read_free(archive);
 		throw std::filesystem::filesystem_error(
 			"Unable to open archive", filePath,
 			std::make_error_code(std::errc::io_error));
 	}
+	return archive;
+}
+
+void processArchiveFile(
+	const std::filesystem::path& filePath,
+	std::function<void(const ArchiveFile&)> func) {
+	TraceSpan span("processArchiveFile");
+	auto archive = openArchive(filePath);
 
 	struct archive_entry* entry;
 
@@ -70,14 +106,298 @@ void processArchiveFile(
 		auto r = archive_read_next_header(archive, &entry);
 		if (r == ARCHIVE_EOF) { break; }
 		if (r != ARCHIVE_OK) {
-			archive_read_close(archive);
-			throw std::invalid_argument(
-				std::string("Unable to read next header: ") +
-				archive_error_string(archive));
+			// The message lives in the archive, copy it before freeing
+			std::string error = archive_error_string(archive) == nullptr
+									? ""
+									: archive_error_string(archive);
+			archive_read_free(archive);
+			throw std::invalid_argument("Unable to read next header: " + error);
 		}
-		func(ArchiveFile(archive, entry));
+		try {
+			func(ArchiveFile(archive, entry));
+		} catch (...) {
+			archive_read_free(archive);
+			throw;
+		}
+		// Data `func` didn't read is skipped over rather than decompressed
+		archive_read_data_skip(archive);
 	}
 
 	archive_read_close(archive);
 	archive_read_free(archive);
 }
+
+std::optional<ArchiveStamp> archiveStamp(const std::filesystem::path& path) {
+	std::error_code ec;
+	const auto size = std::filesystem::file_size(path, ec);
+	if (ec) { return std::nullopt; }
+	const auto time = std::filesystem::last_write_time(path, ec);
+	if (ec) { return std::nullopt; }
+	return ArchiveStamp{
+		static_cast<int64_t>(size),
+		static_cast<int64_t>(time.time_since_epoch().count())};
+}
+
+// Little endian integer of `bytes` length, as stored in ZIP records
+uint32_t readLE(const char* p, int bytes) {
+	uint32_t value = 0;
+	for (int i = bytes - 1; i >= 0; --i) {
+		value = (value << 8) | static_cast<uint8_t>(p[i]);
+	}
+	return value;
+}
+
+const uint32_t ZIP_LOCAL_HEADER_SIGNATURE = 0x04034b50;
+const uint32_t ZIP_CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+const uint32_t ZIP_END_OF_DIRECTORY_SIGNATURE = 0x06054b50;
+const int64_t ZIP_LOCAL_HEADER_SIZE = 30;
+const int64_t ZIP_CENTRAL_HEADER_SIZE = 46;
+const int64_t ZIP_END_OF_DIRECTORY_SIZE = 22;
+// Optional data descriptor after the data: signature, crc and two sizes
+const int64_t ZIP_DATA_DESCRIPTOR_SIZE = 24;
+
+ArchiveIndex::ArchiveIndex(const std::filesystem::path& archivePath)
+	: archivePath(archivePath), seekable(false) {
+	seekable = readCentralDirectory();
+	if (!seekable) { readHeaders(); }
+	buildLookup();
+}
+
+ArchiveIndex::ArchiveIndex(
+	const std::filesystem::path& archivePath, std::vector<ArchiveEntry> entries,
+	bool seekable)
+	: archivePath(archivePath),
+	  entries(std::move(entries)),
+	  seekable(seekable) {
+	buildLookup();
+}
+
+std::optional<ArchiveIndex> ArchiveIndex::fromCentralDirectory(
+	const std::filesystem::path& archivePath) {
+	ArchiveIndex index(archivePath, {}, true);
+	if (!index.readCentralDirectory()) { return std::nullopt; }
+	index.buildLookup();
+	return index;
+}
+
+void ArchiveIndex::buildLookup() {
+	lookup.clear();
+	for (auto i = 0u; i < entries.size(); ++i) {
+		lookup.emplace(entries[i].path.string(), i);
+	}
+}
+
+const ArchiveEntry* ArchiveIndex::find(
+	const std::filesystem::path& entryPath) const {
+	auto it = lookup.find(entryPath.string());
+	if (it == lookup.end()) { return nullptr; }
+	return &entries[it->second];
+}
+
+void ArchiveIndex::add(const ArchiveEntry& entry) {
+	if (!lookup.emplace(entry.path.string(), entries.size()).second) {
+		return;
+	}
+	entries.push_back(entry);
+}
+
+bool ArchiveIndex::readCentralDirectory() {
+	std::ifstream file(archivePath, std::ios::binary);
+	if (!file) { return false; }
+	file.seekg(0, std::ios::end);
+	const int64_t fileSize = file.tellg();
+	if (fileSize < ZIP_END_OF_DIRECTORY_SIZE) { return false; }
+
+	// End of central directory record is followed by a comment of at most
+	// 64KB, so only the tail of the file has to be searched
+	const auto tailSize =
+		std::min<int64_t>(fileSize, ZIP_END_OF_DIRECTORY_SIZE + 0xFFFF);
+	std::vector<char> tail(tailSize);
+	file.seekg(fileSize - tailSize);
+	file.read(tail.data(), tailSize);
+	if (!file) { return false; }
+
+	int64_t end = tailSize - ZIP_END_OF_DIRECTORY_SIZE;
+	while (end >= 0 &&
+		   readLE(&tail[end], 4) != ZIP_END_OF_DIRECTORY_SIGNATURE) {
+		end--;
+	}
+	if (end < 0) { return false; }
+
+	const auto count = readLE(&tail[end + 10], 2);
+	const int64_t directorySize = readLE(&tail[end + 12], 4);
+	const int64_t directoryOffset = readLE(&tail[end + 16], 4);
+	// ZIP64 archives saturate these fields, leave them to libarchive
+	if (count == 0xFFFF || directorySize == 0xFFFFFFFF ||
+		directoryOffset == 0xFFFFFFFF ||
+		directoryOffset + directorySize > fileSize - tailSize + end) {
+		return false;
+	}
+
+	std::vector<char> directory(directorySize);
+	file.seekg(directoryOffset);
+	file.read(directory.data(), directorySize);
+	if (!file) { return false; }
+
+	std::vector<ArchiveEntry> found;
+	int64_t pos = 0;
+	for (auto i = 0u; i < count; ++i) {
+		if (pos + ZIP_CENTRAL_HEADER_SIZE > directorySize) { return false; }
+		const auto* header = &directory[pos];
+		if (readLE(header, 4) != ZIP_CENTRAL_HEADER_SIGNATURE) {
+			return false;
+		}
+		const auto flags = readLE(header + 8, 2);
+		const auto method = readLE(header + 10, 2);
+		const auto compressedSize = readLE(header + 20, 4);
+		const auto size = readLE(header + 24, 4);
+		const auto nameLength = readLE(header + 28, 2);
+		const auto extraLength = readLE(header + 30, 2);
+		const auto commentLength = readLE(header + 32, 2);
+		const auto offset = readLE(header + 42, 4);
+
+		if (pos + ZIP_CENTRAL_HEADER_SIZE + nameLength > directorySize) {
+			return false;
+		}
+		std::string name(header + ZIP_CENTRAL_HEADER_SIZE, nameLength);
+		pos += ZIP_CENTRAL_HEADER_SIZE + nameLength + extraLength +
+			   commentLength;
+
+		// Encrypted and ZIP64 entries are left to libarchive
+		if ((flags & 1) != 0 || compressedSize == 0xFFFFFFFF ||
+			size == 0xFFFFFFFF || offset == 0xFFFFFFFF) {
+			return false;
+		}
+		if (name.empty() || name.back() == '/') { continue; }
+		found.push_back(
+			{std::filesystem::path(name).make_preferred(), size, offset,
+			 compressedSize, static_cast<int>(method)});
+	}
+	entries = std::move(found);
+	return true;
+}
+
+void ArchiveIndex::readHeaders() {
+	entries.clear();
+	processArchiveFile(archivePath, [&](const ArchiveFile& file) {
+		if (!file.isFile()) { return; }
+		entries.push_back({file.path(), file.size(), file.offset(), -1, -1});
+	});
+}
+
+ArchiveReader::ArchiveReader(const std::filesystem::path& archivePath)
+	: archiveIndex(archivePath), cursor(nullptr), cursorOffset(-1) {}
+
+ArchiveReader::ArchiveReader(ArchiveIndex index)
+	: archiveIndex(std::move(index)), cursor(nullptr), cursorOffset(-1) {}
+
+ArchiveReader::~ArchiveReader() { closeCursor(); }
+
+void ArchiveReader::closeCursor() {
+	if (cursor != nullptr) { archive_read_free(cursor); }
+	cursor = nullptr;
+	cursorOffset = -1;
+}
+
+void ArchiveReader::add(const std::vector<ArchiveEntry>& entries) {
+	std::lock_guard<std::mutex> guard(lock);
+	for (const auto& entry : entries) { archiveIndex.add(entry); }
+}
+
+void ArchiveReader::read(
+	const std::filesystem::path& entryPath,
+	std::function<void(const ArchiveFile&)> func) {
+	// Includes waiting for other threads' reads
+	TraceSpan span("ArchiveReader::read");
+	std::lock_guard<std::mutex> guard(lock);
+	const auto* entry = archiveIndex.find(entryPath);
+	if (entry == nullptr) {
+		throw std::filesystem::filesystem_error(
+			"Entry not found in archive", archiveIndex.path(), entryPath,
+			std::make_error_code(std::errc::no_such_file_or_directory));
+	}
+	if (archiveIndex.isSeekable()) {
+		readDirect(*entry, func);
+	} else {
+		readSequential(*entry, func);
+	}
+}
+
+void ArchiveReader::readDirect(
+	const ArchiveEntry& entry, std::function<void(const ArchiveFile&)> func) {
+	std::ifstream file(archiveIndex.path(), std::ios::binary);
+	std::vector<char> buffer(ZIP_LOCAL_HEADER_SIZE);
+	file.seekg(entry.offset);
+	file.read(buffer.data(), ZIP_LOCAL_HEADER_SIZE);
+	if (!file || readLE(buffer.data(), 4) != ZIP_LOCAL_HEADER_SIGNATURE) {
+		// Offsets are off when data is prepended to the archive
+		readSequential(entry, func);
+		return;
+	}
+
+	// Hand libarchive just this entry's local record
+	const auto headerSize = ZIP_LOCAL_HEADER_SIZE +
+							readLE(&buffer[26], 2) + readLE(&buffer[28], 2);
+	buffer.resize(
+		headerSize + entry.compressedSize + ZIP_DATA_DESCRIPTOR_SIZE);
+	file.read(
+		buffer.data() + ZIP_LOCAL_HEADER_SIZE,
+		buffer.size() - ZIP_LOCAL_HEADER_SIZE);
+	buffer.resize(ZIP_LOCAL_HEADER_SIZE + file.gcount());
+
+	auto archive = archive_read_new();
+	if (archive == nullptr) {
+		throw std::invalid_argument("Couldn't create archive reader");
+	}
+	struct archive_entry* header;
+	if (archive_read_support_format_zip_streaming(archive) != ARCHIVE_OK ||
+		archive_read_open_memory(archive, buffer.data(), buffer.size()) !=
+			ARCHIVE_OK ||
+		archive_read_next_header(archive, &header) != ARCHIVE_OK) {
+		std::string error = archive_error_string(archive) == nullptr
+								? ""
+								: archive_error_string(archive);
+		archive_read_free(archive);
+		throw std::invalid_argument("Unable to read entry: " + error);
+	}
+	try {
+		func(ArchiveFile(archive, header));
+	} catch (...) {
+		archive_read_free(archive);
+		throw;
+	}
+	archive_read_free(archive);
+}
+
+void ArchiveReader::readSequential(
+	const ArchiveEntry& entry, std::function<void(const ArchiveFile&)> func) {
+	// Only restart from the beginning when going backwards
+	if (cursor == nullptr || cursorOffset >= entry.offset) {
+		closeCursor();
+		cursor = openArchive(archiveIndex.path());
+	}
+
+	struct archive_entry* header;
+	while (true) {
+		auto r = archive_read_next_header(cursor, &header);
+		if (r != ARCHIVE_OK) {
+			std::string error = r == ARCHIVE_EOF
+									? "Entry not found"
+									: archive_error_string(cursor);
+			closeCursor();
+			throw std::invalid_argument("Unable to read entry: " + error);
+		}
+		ArchiveFile file(cursor, header);
+		cursorOffset = file.offset();
+		if (cursorOffset == entry.offset && file.path() == entry.path) {
+			func(file);
+			return;
+		}
+		if (cursorOffset > entry.offset) {
+			closeCursor();
+			throw std::filesystem::filesystem_error(
+				"Entry not found in archive", archiveIndex.path(),
+				entry.path, std::make_error_code(std::errc::io_error));
+		}
+	}
+}
@@ -1,9 +1,12 @@
 #include "archive.hpp"
 
+#include <benchmark/benchmark.h>
 #include <gtest/gtest.h>
 
 #include <map>
 
+#include "fixtures.hpp"
+
 class ArchiveTestFixtures
 	: public ::testing::TestWithParam<std::filesystem::path> {};
 
@@ -13,7 +16,7 @@ TEST_P(ArchiveTestFixtures, VerifyArchive) {
 		{"a/b.txt", 1}, {"c.txt", 2}, {"test.png", 11645}};
 
 	std::map<std::filesystem::path, int64_t> filesFound;
-	auto tempDir = std::filesystem::path(std::tmpnam(nullptr));
+	const auto tempDir = uniqueTempDirectory("comic_reader_archive");
 
 	processArchiveFile(filePath, [&](const ArchiveFile& file) {
 		if (file.isFile()) {
@@ -28,6 +31,51 @@ TEST_P(ArchiveTestFixtures, VerifyArchive) {
 	std::filesystem::remove_all(tempDir);
 }
 
+TEST_P(ArchiveTestFixtures, ReadEntryFromIndex) {
+	auto filePath = GetParam();
+	ArchiveReader reader(filePath);
+	EXPECT_EQ(reader.index().isSeekable(), filePath.extension() == ".zip");
+	EXPECT_EQ(reader.index().files().size(), 3);
+	EXPECT_EQ(reader.index().find("missing.txt"), nullptr);
+
+	// Out of archive order, to force the sequential cursor to rewind
+	for (auto name : {"test.png", "a/b.txt", "c.txt", "a/b.txt"}) {
+		const auto entryPath = std::filesystem::path(name).make_preferred();
+		const auto* entry = reader.index().find(entryPath);
+		ASSERT_NE(entry, nullptr);
+		reader.read(entryPath, [&](const ArchiveFile& file) {
+			EXPECT_EQ(file.path(), entryPath);
+			EXPECT_EQ(entry->size, file.readContent().size());
+		});
+	}
+	EXPECT_ANY_THROW(reader.read("missing.txt", [](const ArchiveFile&) {}));
+}
+
 INSTANTIATE_TEST_SUITE_P(
 	VerifyArchive, ArchiveTestFixtures,
 	::testing::Values("testdata/test.zip", "testdata/test.rar"));
+
+// Args are the page count and the archive format, pages are 1200x1800 JPEGs
+ComicFixture archiveFixture(const benchmark::State& state) {
+	ComicFixture fixture;
+	fixture.pages = state.range(0);
+	fixture.archive = ArchiveFormat(state.range(1));
+	return fixture;
+}
+
+void BM_ProcessArchiveFile(benchmark::State& state) {
+	const auto file = fixtureComic(archiveFixture(state));
+	int64_t bytes = 0;
+	for (auto _ : state) {
+		processArchiveFile(file, [&bytes](const ArchiveFile& entry) {
+			const auto content = entry.readContent();
+			benchmark::DoNotOptimize(content.data());
+			bytes += content.size();
+		});
+	}
+	state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_ProcessArchiveFile)
+	->ArgNames({"pages", "archive"})
+	->ArgsProduct({{16, 64}, {0, 1}})
+	->Unit(benchmark::kMillisecond);
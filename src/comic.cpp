@@ -1,8 +1,13 @@
 #include "comic.hpp"
 
+#include <wx/log.h>
 #include <wx/settings.h>
+#include <wx/stdpaths.h>
 
+#include <algorithm>
+#include <cstdlib>
 #include <filesystem>
+#include <sstream>
 
 #include "archive.hpp"
 #include "image_utils.hpp"
@@ -14,55 +19,147 @@ int GET_THUMB_DIM() {
 		wxSystemSettings::GetMetric(wxSYS_SCREEN_Y));
 	return THUMB_DIM;
 }
+
+const ThumbnailFormat& GET_THUMB_FORMAT() {
+	const static auto THUMB_FORMAT =
+		thumbnailFormat(std::getenv("COMIC_READER_THUMBNAIL"));
+	return THUMB_FORMAT;
+}
 const std::filesystem::path cacheDirectory =
 	std::filesystem::temp_directory_path() / "comicReaderCache";
 
-std::filesystem::path getCoverPath(
-	const std::filesystem::path& comic, const std::filesystem::path& img) {
-	auto path = cacheDirectory / comic.stem();
-	path += "_Cover";
-	path += img.extension();
-	return path;
+std::filesystem::path getDataDirectory() {
+	const static std::filesystem::path dataDirectory =
+		wxStandardPaths::Get().GetUserLocalDataDir().ToStdString();
+	return dataDirectory;
+}
+
+std::filesystem::path getManifestPath(const std::filesystem::path& comic) {
+	// FNV-1a, unlike std::hash it is stable between builds
+	uint64_t hash = 14695981039346656037ull;
+	for (auto c : comic.string()) {
+		hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+	}
+	std::ostringstream name;
+	name << std::hex << hash << ".manifest";
+	return getDataDirectory() / "manifests" / name.str();
 }
 
 Comic::Comic(const std::filesystem::path& comicPath)
-	: comicPath(comicPath), size(0) {
-	wxString cover;
-	std::string extension;
-
-	processArchiveFile(comicPath, [&](const ArchiveFile& file) {
-		if (!file.isFile() || !isImage(file.path())) { return; }
-		size++;
-		auto fullPath = cacheDirectory / file.path();
-		if (!cover.empty() && wxCmpNatural(cover, fullPath.string()) < 0) {
-			return;
-		}
-		cover = fullPath.string();
-		coverPage = getCoverPath(comicPath, fullPath);
-		file.writeContent(coverPage);
+	: comicPath(comicPath), size(0), manifestChanged(false) {
+	// Pages are found from entry names alone, ZIP archives only need their
+	// central directory. Just the cover is decompressed.
+	ArchiveReader coverReader(comicPath);
+	const auto index = PageManifest::build(coverReader.index());
+	size = index.pages.size();
+	if (size == 0) { return; }
+	coverPage = index.entries[index.pages.front()].path;
+	std::vector<uint8_t> coverContent;
+	coverReader.read(coverPage, [&coverContent](const ArchiveFile& file) {
+		coverContent = file.readContent();
 	});
-	saveThumbnail(coverPage, coverPage, GET_THUMB_DIM());
+	thumbnail = makeThumbnail(
+		coverContent, coverPage, GET_THUMB_DIM(), GET_THUMB_FORMAT());
 }
 
+Comic::Comic(const std::filesystem::path& comicPath, int size)
+	: comicPath(comicPath), size(size), manifestChanged(false) {}
+
 int Comic::length() const { return size; };
 std::string Comic::getName() const { return comicPath.stem().string(); };
 
-void Comic::load(std::function<void(int i)> progress) {
+bool Comic::load() {
 	unload();
-	const auto extractedCache = cacheDirectory / comicPath.stem();
-	processArchiveFile(comicPath, [&](const ArchiveFile& file) {
-		if (!file.isFile() || !isImage(file.path())) { return; }
-		pages.push_back(extractedCache / file.path());
-		file.writeContent(pages.back());
-		if (progress) { progress(pages.size() - 1); }
-	});
-	std::sort(pages.begin(), pages.end(), [](const auto& a, const auto& b) {
-		return wxCmpNatural(a.string(), b.string()) < 0;
-	});
+	manifest = PageManifest::load(comicPath, getManifestPath(comicPath));
+	if (manifest) {
+		reader = std::make_shared<ArchiveReader>(
+			ArchiveIndex(comicPath, manifest->entries, manifest->seekable));
+	} else if (auto index = ArchiveIndex::fromCentralDirectory(comicPath)) {
+		reader = std::make_shared<ArchiveReader>(std::move(*index));
+		manifest = PageManifest::build(reader->index());
+		manifestChanged = true;
+		saveManifest();
+	} else {
+		// Listing the entries would already decompress the whole archive.
+		// Streamed pages are added to the reader as they are seen.
+		reader = std::make_shared<ArchiveReader>(
+			ArchiveIndex(comicPath, {}, false));
+		size = 0;
+		return false;
+	}
+	for (auto i : manifest->pages) {
+		pages.push_back(manifest->entries[i].path);
+	}
+	size = pages.size();
+	return true;
+}
+
+int Comic::addStreamedPage(const ArchiveEntry& page) {
+	reader->add({page});
+	const auto it =
+		std::upper_bound(pages.begin(), pages.end(), page.path, pageOrder);
+	const auto i = static_cast<int>(it - pages.begin());
+	pages.insert(it, page.path);
 	size = pages.size();
+	return i;
+}
+
+bool Comic::finishStream(std::vector<ArchiveEntry> entries) {
+	// Same reader, pages may be read through it meanwhile
+	reader->add(entries);
+	manifest = PageManifest::build(reader->index());
+	manifestChanged = true;
+	saveManifest();
+	std::vector<std::filesystem::path> ordered;
+	for (auto i : manifest->pages) {
+		ordered.push_back(manifest->entries[i].path);
+	}
+	const auto reordered = ordered != pages;
+	pages = std::move(ordered);
+	size = pages.size();
+	return reordered;
+}
+
+std::vector<uint8_t> Comic::readPage(int i) { return readPage(pages[i]); }
+
+std::vector<uint8_t> Comic::readPage(const std::filesystem::path& page) {
+	std::vector<uint8_t> content;
+	reader->read(page, [&](const ArchiveFile& file) {
+		content = file.readContent();
+	});
+	return content;
+}
+
+wxSize Comic::pageSize(int i) const {
+	if (!manifest) { return wxDefaultSize; }
+	return manifest->sizes[i];
+}
+
+void Comic::setPageSize(int i, const wxSize& size) {
+	if (!manifest || size.GetWidth() <= 0 || size.GetHeight() <= 0) {
+		return;
+	}
+	if (manifest->sizes[i] != size) {
+		manifest->sizes[i] = size;
+		manifestChanged = true;
+	}
+}
+
+void Comic::saveManifest() {
+	if (!manifest || !manifestChanged) { return; }
+	try {
+		manifest->save(comicPath, getManifestPath(comicPath));
+		manifestChanged = false;
+	} catch (const std::exception& e) {
+		wxLogWarning(
+			"Unable to save manifest for %s: %s", comicPath.string(),
+			e.what());
+	}
 }
 
 void Comic::unload() {
+	saveManifest();
+	manifest.reset();
 	pages.clear();
-	std::filesystem::remove_all(cacheDirectory / comicPath.stem());
+	reader.reset();
 }
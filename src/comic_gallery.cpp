@@ -1,29 +1,51 @@
 #include "comic_gallery.hpp"
 
 #include <wx/dcbuffer.h>
+#include <wx/log.h>
 #include <wx/progdlg.h>
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <future>
-#include <queue>
+#include <memory>
+#include <thread>
 
 #include "comic.hpp"
 #include "comic_viewer.hpp"
 #include "fuzzy.hpp"
+#include "trace.hpp"
 #include "util.hpp"
 #include "wxUtil.hpp"
 
 const int GALLERY_UPDATE_ID = 100000;
 
+// Natural order of names, the full path breaks ties
+bool comicOrder(
+	const std::filesystem::path& a, const std::filesystem::path& b) {
+	const auto order = wxCmpNatural(a.stem().string(), b.stem().string());
+	return order != 0 ? order < 0 : a < b;
+}
+
 ComicGallery::ComicGallery(
 	wxWindow* parent, const std::vector<std::filesystem::path>& paths)
-	: wxPanel(parent), index(0), workInBackground(false) {
+	: wxPanel(parent),
+	  nextCover(0),
+	  index(0),
+	  pool(this),
+	  thumbnails(getDataDirectory() / "thumbnails.pack"),
+	  workInBackground(false),
+	  ingestTotal(0),
+	  ingestFinished(0),
+	  activeLoaders(0) {
 	Bind(wxEVT_PAINT, &ComicGallery::OnPaint, this);
 	Bind(wxEVT_SIZE, &ComicGallery::OnSize, this);
 	Bind(
 		wxEVT_COMMAND_TEXT_UPDATED, &ComicGallery::OnComicAddition, this,
 		GALLERY_UPDATE_ID);
+	Bind(
+		wxEVT_COMMAND_TEXT_UPDATED, &ComicGallery::OnImageReady, this,
+		IMAGE_POOL_UPDATE_ID);
 
 	SetBackgroundStyle(wxBG_STYLE_PAINT);
 	SetBackgroundColour(wxColour(25, 25, 25));
@@ -31,69 +53,255 @@ ComicGallery::ComicGallery(
 	loadComics(paths);
 }
 
-ComicGallery::~ComicGallery() {
+ComicGallery::~ComicGallery() { StopLoading(); }
+
+void ComicGallery::StopLoading() {
 	if (workInBackground.load()) {
 		wxProgressDialog dialog("Stopping Background Threads", "");
 		dialog.Pulse();
 		workInBackground.store(false);
-		loader.wait();
 	}
+	for (auto& loader : loaders) { loader.wait(); }
+	loaders.clear();
+	std::lock_guard<std::mutex> guard(ingestLock);
+	ingestQueue.clear();
+	ingested.clear();
+	ingestTotal = ingestFinished = 0;
 }
 
 bool ComicGallery::AddComic(std::filesystem::path path) {
+	auto comic = ScanComic(path);
+	if (!comic) { return false; }
+	PublishComic(std::move(*comic));
+	return true;
+}
+
+std::optional<Comic> ComicGallery::ScanComic(
+	const std::filesystem::path& path) {
+	if (auto entry = thumbnails.find(path)) {
+		if (entry->pages == 0) { return std::nullopt; }
+		Comic c(path, entry->pages);
+		c.thumbnail.width = entry->width;
+		c.thumbnail.height = entry->height;
+		c.thumbnail.extension = entry->extension;
+		return c;
+	}
 	Comic c(path);
-	if (c.length() > 0) {
-		pool.addImage(c.coverPage);
-		comics.push_back(c);
-		return true;
+	// Archives without images are remembered too, so they aren't rescanned
+	if (thumbnails.add(path, c.length(), c.thumbnail)) {
+		c.thumbnail.content = std::vector<uint8_t>();
 	}
-	return false;
+	if (c.length() == 0) { return std::nullopt; }
+	return c;
 }
 
-void ComicGallery::loadComics(std::vector<std::filesystem::path> paths) {
-	if (paths.empty()) { return; }
-	std::sort(paths.begin(), paths.end(), [](const auto& a, const auto& b) {
-		return wxCmpNatural(a.stem().string(), b.stem().string()) < 0;
-	});
+int ComicGallery::PublishComic(Comic comic) {
+	const auto replacesCurrent =
+		!comics.empty() && comics[index]->path() == comic.path();
+	RemoveComic(comic.path());
+	auto cover = comic.path();
+	cover.replace_extension(comic.thumbnail.extension);
+	const wxSize size(comic.thumbnail.width, comic.thumbnail.height);
+	if (comic.thumbnail.content.empty()) {
+		pool.addImage(
+			cover,
+			[this, path = comic.path()]() { return thumbnails.read(path); },
+			size);
+	} else {
+		// Not in the pack, keep the thumbnail in memory. The reader owns
+		// the bytes, it runs on workers while comics may be reallocated.
+		auto content = std::make_shared<const std::vector<uint8_t>>(
+			std::move(comic.thumbnail.content));
+		pool.addImage(
+			cover, [content]() { return *content; }, size);
+	}
+	const auto it = std::upper_bound(
+		comics.begin(), comics.end(), comic.path(),
+		[](const auto& path, const auto& c) {
+			return comicOrder(path, c->path());
+		});
+	const auto pos = static_cast<int>(std::distance(comics.begin(), it));
+	comics.insert(it, std::make_unique<Comic>(std::move(comic)));
+	covers.insert(covers.begin() + pos, nextCover++);
+	// Typical page proportions until the cover has been decoded
+	aspects.insert(aspects.begin() + pos, 2.0 / 3.0);
+	updateAspect(pos);
+	if (replacesCurrent) {
+		index = pos;
+	} else if (pos <= index && comics.size() > 1) {
+		// The comic in view stays in view
+		++index;
+	}
+	return pos;
+}
+
+void ComicGallery::RemoveComic(const std::filesystem::path& path) {
+	const auto it = std::lower_bound(
+		comics.begin(), comics.end(), path, [](const auto& c, const auto& p) {
+			return comicOrder(c->path(), p);
+		});
+	if (it == comics.end() || (*it)->path() != path) { return; }
+	const auto pos = static_cast<int>(std::distance(comics.begin(), it));
+	// Its pool slot stays empty, the pool only ever grows
+	pool.unload(covers[pos]);
+	comics.erase(it);
+	covers.erase(covers.begin() + pos);
+	aspects.erase(aspects.begin() + pos);
+	// Drawn from indices that have shifted
+	visible.clear();
+	if (pos < index || index == static_cast<int>(comics.size())) {
+		index = std::max(index - 1, 0);
+	}
+}
+
+std::vector<std::filesystem::path> ComicGallery::nearestFirst(
+	std::vector<std::filesystem::path> paths) const {
+	std::sort(paths.begin(), paths.end(), comicOrder);
 	paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
-	comics.reserve(paths.size());
 
+	// Outward from where the comic in view is or would go
+	size_t start = 0;
+	if (!comics.empty()) {
+		const auto it = std::lower_bound(
+			paths.begin(), paths.end(), comics[index]->path(), comicOrder);
+		start = std::distance(paths.begin(), it);
+	}
+	std::vector<std::filesystem::path> order;
+	order.reserve(paths.size());
+	for (size_t d = 0; order.size() < paths.size(); ++d) {
+		if (start + d < paths.size()) { order.push_back(paths[start + d]); }
+		if (d > 0 && d <= start) { order.push_back(paths[start - d]); }
+	}
+	return order;
+}
+
+void ComicGallery::loadComics(
+	std::vector<std::filesystem::path> paths, unsigned int workers) {
+	if (paths.empty()) { return; }
+	StopLoading();
+	auto order = nearestFirst(std::move(paths));
+
+	// One is scanned right away, so there is something to show
 	auto offset = 0u;
-	for (; offset < paths.size(); ++offset) {
-		if (AddComic(paths[offset])) { break; }
+	while (offset < order.size() && !AddComic(order[offset++])) {}
+	order.erase(order.begin(), order.begin() + offset);
+	ingest(order, workers);
+}
+
+void ComicGallery::ingest(
+	const std::vector<std::filesystem::path>& paths, unsigned int workers) {
+	if (paths.empty()) { return; }
+	if (workers == 0) { workers = std::thread::hardware_concurrency(); }
+
+	std::lock_guard<std::mutex> guard(ingestLock);
+	// Loaders that ran out of work have returned
+	std::erase_if(loaders, [](const auto& loader) {
+		return loader.wait_for(std::chrono::seconds(0)) ==
+			   std::future_status::ready;
+	});
+	if (activeLoaders == 0) { ingestTotal = ingestFinished = 0; }
+	ingestQueue.insert(ingestQueue.end(), paths.begin(), paths.end());
+	ingestTotal += paths.size();
+
+	workers = std::clamp(
+		workers, 1u, static_cast<unsigned int>(ingestQueue.size()));
+	workInBackground.store(true);
+	for (; activeLoaders < workers; ++activeLoaders) {
+		loaders.push_back(
+			std::async(std::launch::async, [this]() { IngestComics(); }));
 	}
+}
 
-	workInBackground.store(false);
+void ComicGallery::changeComics(
+	std::vector<std::filesystem::path> added,
+	const std::vector<std::filesystem::path>& removed) {
+	{
+		// Not published yet, so not in comics
+		std::lock_guard<std::mutex> guard(ingestLock);
+		for (const auto& path : removed) {
+			ingestTotal -= std::erase(ingestQueue, path);
+			std::erase_if(ingested, [&path](const Comic& comic) {
+				return comic.path() == path;
+			});
+		}
+	}
+	for (const auto& path : removed) { RemoveComic(path); }
+	if (comics.empty() && !workInBackground.load()) {
+		// Nothing to keep, load them like a new gallery
+		loadComics(std::move(added));
+	} else {
+		ingest(nearestFirst(std::move(added)), 0);
+	}
+	Refresh();
+}
 
-	if (!paths.empty()) {
-		workInBackground.store(true);
-		loader = std::async([paths, offset, this]() {
-			for (auto i = offset + 1; i < paths.size(); ++i) {
-				if (!workInBackground.load()) { return; }
-				if (AddComic(paths[i])) {
-					GetEventHandler()->AddPendingEvent(wxCommandEvent(
-						wxEVT_COMMAND_TEXT_UPDATED, GALLERY_UPDATE_ID));
-				};
+void ComicGallery::IngestComics() {
+	while (true) {
+		std::filesystem::path path;
+		{
+			std::lock_guard<std::mutex> guard(ingestLock);
+			if (!workInBackground.load() || ingestQueue.empty()) {
+				// Under the lock, so ingest() starts a loader if it must
+				if (--activeLoaders == 0) { workInBackground.store(false); }
+				return;
 			}
-			workInBackground.store(false);
-		});
+			path = std::move(ingestQueue.front());
+			ingestQueue.pop_front();
+		}
+
+		std::optional<Comic> comic;
+		try {
+			comic = ScanComic(path);
+		} catch (const std::exception& e) {
+			// On a loader thread, so not in the user's face
+			wxLogTrace("gallery", "Skipping %s: %s", path.string(), e.what());
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(ingestLock);
+			if (comic) { ingested.push_back(std::move(*comic)); }
+			++ingestFinished;
+		}
+		GetEventHandler()->AddPendingEvent(
+			wxCommandEvent(wxEVT_COMMAND_TEXT_UPDATED, GALLERY_UPDATE_ID));
+	}
+}
+
+// Runs on the UI thread, comics are inserted wherever they belong
+void ComicGallery::PublishComics() {
+	std::vector<Comic> batch;
+	{
+		std::lock_guard<std::mutex> guard(ingestLock);
+		batch.swap(ingested);
 	}
-	index = 0;
+	for (auto& comic : batch) { PublishComic(std::move(comic)); }
 }
 
-void ComicGallery::verify(const wxGraphicsContext* gc, int i) {}
+void ComicGallery::updateAspect(int i) {
+	const auto& size = pool.knownSize(covers[i]);
+	if (size == wxDefaultSize) { return; }
+	aspects[i] = double(size.GetWidth()) / size.GetHeight();
+}
 
-template <typename T, typename U> T mix(T x, T y, U a) {
-	return x * (1 - a) + a * y;
+void ComicGallery::OnComicAddition(wxCommandEvent& event) {
+	PublishComics();
+	Refresh();
 }
 
-void ComicGallery::OnComicAddition(wxCommandEvent& event) { Refresh(); }
+void ComicGallery::OnImageReady(wxCommandEvent& event) {
+	// A decoded cover can be shaped differently from what its thumbnail said
+	for (const auto& cover : visible) { updateAspect(cover.index); }
+	Refresh();
+}
 
 void ComicGallery::OnPaint(wxPaintEvent& event) {
-	const double FOCUSED_COMIC = 0.9, REST_COMIC = 0.7;
+	TraceSpan span("ComicGallery::OnPaint", true);
 
 	if (comics.empty()) { return; }
 
+	// Whichever view is painting is the one on screen
+	pool.activate();
+
 	wxAutoBufferedPaintDC dc(this);
 	dc.Clear();
 
@@ -104,104 +312,41 @@ void ComicGallery::OnPaint(wxPaintEvent& event) {
 	if (gc) {
 		const auto cw = GetClientSize().GetWidth();
 		const auto ch = GetClientSize().GetHeight();
-
-		int idx = index, nextIdx = index;
-		float frac = 0.0f;
-
-		if (animator.IsRunning()) {
-			idx = static_cast<int>(std::floor(animatingIndex));
-			nextIdx = static_cast<int>(std::ceil(animatingIndex));
-			frac = animatingIndex - idx;
-		}
+		const double position =
+			animator.IsRunning() ? animatingIndex : index;
+		const auto shown = std::clamp(
+			static_cast<int>(std::floor(position)), 0,
+			static_cast<int>(comics.size()) - 1);
+		const auto& comic = *comics[shown];
 
 		auto textHeight = drawWrappedText(
-			{comics[idx].getName(), std::to_string(comics[idx].length())}, gc,
-			cw, ch);
-		const double GAP = 0.1 * (ch - textHeight);
-
-		const auto size = comics.size();
-		std::vector<wxRealPoint> pos(size);
-		std::vector<double> scale(size, 1);
-		std::vector<double> width(size, 0);
-
-		std::queue<int> coversToConsider;
-		std::vector<int> coversToDraw;
-
-		{
-			verify(gc, idx);
-			const auto iw = pool.size(idx).GetWidth();
-			const auto ih = pool.size(idx).GetHeight();
-
-			scale[idx] =
-				std::min(double(ch - textHeight) / ih, double(cw) / iw);
-			scale[idx] *= mix(FOCUSED_COMIC, REST_COMIC, frac);
-
-			width[idx] = scale[idx] * iw;
-
-			pos[idx].x = 0.5 * cw;
-			pos[idx].y = 0.5 * (ch - textHeight);
-		}
-
-		coversToConsider.push(idx + 1);
-		coversToConsider.push(idx - 1);
-
-		while (coversToConsider.size() > 0) {
-			auto i = coversToConsider.front();
-			coversToConsider.pop();
-
-			if (i < 0 || i >= size) continue;
-			verify(gc, i);
-
-			auto sgn = i > idx ? 1 : -1;
-
-			const auto iw = pool.size(i).GetWidth();
-			const auto ih = pool.size(i).GetHeight();
-
-			scale[i] = double(ch - textHeight) / ih;
-			if (i == nextIdx) {
-				scale[i] *= mix(REST_COMIC, FOCUSED_COMIC, frac);
-			} else {
-				scale[i] *= REST_COMIC;
-			}
-
-			width[i] = scale[i] * iw;
-
-			pos[i].x = pos[i - sgn].x +
-					   sgn * (0.5 * (width[i - sgn] + width[i]) + GAP);
-			pos[i].y = pos[i - sgn].y;
-
-			if ((sgn > 0 && (pos[i].x - width[i] / 2) <= cw) ||
-				(sgn < 0 && (pos[i].x + width[i] / 2) >= 0)) {
-				coversToDraw.push_back(i);
-				coversToConsider.push(i + sgn);
-			}
-			if (i == nextIdx) {
-				auto delta = frac * (pos[nextIdx].x - pos[idx].x);
-				pos[i].x -= delta;
-				pos[idx].x -= delta;
-			}
-		}
-		coversToDraw.push_back(idx);
+			{comic.getName(), std::to_string(comic.length())}, gc, cw, ch);
+		layout::coverFlow(
+			aspects, position, {double(cw), ch - textHeight}, visible);
 
 		// Draw loading bar
 		if (workInBackground.load()) {
+			float done = 0;
+			{
+				std::lock_guard<std::mutex> guard(ingestLock);
+				if (ingestTotal) { done = float(ingestFinished) / ingestTotal; }
+			}
 			gc->SetBrush(wxBrush(*wxRED_BRUSH));
 			gc->DrawRectangle(0, 0, cw, 5);
 			gc->SetBrush(wxBrush(*wxGREEN_BRUSH));
-			gc->DrawRectangle(0, 0, float(size * cw) / comics.capacity(), 5);
+			gc->DrawRectangle(0, 0, done * cw, 5);
 		}
 
 		// Draw comics
 		gc->SetInterpolationQuality(wxINTERPOLATION_BEST);
-		for (auto& i : coversToDraw) {
-			const auto iw = pool.size(i).GetWidth();
-			const auto ih = pool.size(i).GetHeight();
-
-			gc->Translate(pos[i].x, pos[i].y);
-			gc->Scale(scale[i], scale[i]);
-			gc->DrawBitmap(pool.bitmap(i), -iw / 2.0, -ih / 2.0, iw, ih);
-			gc->Scale((1 / scale[i]), (1 / scale[i]));
-			gc->Translate(-pos[i].x, -pos[i].y);
+		for (const auto& [i, rect] : visible) {
+			if (pool.request(covers[i])) {
+				gc->DrawBitmap(
+					pool.bitmap(covers[i]), rect.x, rect.y, rect.width,
+					rect.height);
+			} else {
+				drawPlaceholder(gc, rect.x, rect.y, rect.width, rect.height);
+			}
 		}
 
 		delete gc;
@@ -209,8 +354,14 @@ void ComicGallery::OnPaint(wxPaintEvent& event) {
 }
 void ComicGallery::OnSize(wxSizeEvent& event) { Refresh(); }
 
+void ComicGallery::prefetch(int from, int to) {
+	auto wanted = navigation.onNavigate(from, to, comics.size());
+	for (auto& [i, priority] : wanted) { i = covers[i]; }
+	pool.prefetch(wanted);
+}
+
 void ComicGallery::HandleInput(Navigation input, char ch) {
-	if (animator.IsRunning()) { return; }
+	if (animator.IsRunning() || comics.empty()) { return; }
 
 	auto nextIndex = index;
 	switch (input) {
@@ -223,7 +374,7 @@ void ComicGallery::HandleInput(Navigation input, char ch) {
 		case Navigation::JumpToComic: {
 			auto itr =
 				std::find_if(comics.begin(), comics.end(), [ch](const auto& c) {
-					return wxCmpNatural(wxString(ch), c.getName()) < 0;
+					return wxCmpNatural(wxString(ch), c->getName()) < 0;
 				});
 			if (itr == comics.end()) { itr--; }
 			nextIndex = std::distance(comics.begin(), itr);
@@ -233,14 +384,21 @@ void ComicGallery::HandleInput(Navigation input, char ch) {
 			return;
 	}
 	if (index != nextIndex) {
+		prefetch(index, nextIndex);
 		animator.Start(
 			200, index, nextIndex,
 			[this](float v) {
 				animatingIndex = v;
 				Refresh();
 			},
-			[this, nextIndex]() {
-				index = nextIndex;
+			[this, target = comics[nextIndex].get()]() {
+				// Comics may have been published around it meanwhile
+				const auto it = std::find_if(
+					comics.begin(), comics.end(),
+					[target](const auto& c) { return c.get() == target; });
+				if (it != comics.end()) {
+					index = std::distance(comics.begin(), it);
+				}
 				Refresh();
 			});
 	}
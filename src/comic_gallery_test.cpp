@@ -0,0 +1,54 @@
+#include "comic_gallery.hpp"
+
+#include <gtest/gtest.h>
+#include <wx/app.h>
+#include <wx/frame.h>
+
+#include <chrono>
+#include <thread>
+
+#include "fixtures.hpp"
+
+// Publishes what the loaders scanned until the gallery has `count` comics
+bool waitForComics(ComicGallery& gallery, int count) {
+	for (int i = 0; i < 500 && gallery.length() != count; ++i) {
+		wxTheApp->ProcessPendingEvents();
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	return gallery.length() == count;
+}
+
+TEST(comicGallery, KeepsComicsAcrossChanges) {
+	// Thumbnails are kept in the data directory, which needs an app name
+	if (!startWx()) { GTEST_SKIP() << "Unable to start wx"; }
+	ComicFixture fixture;
+	fixture.pages = 2;
+	fixture.pageSize = wxSize(64, 96);
+	const auto source = fixtureComic(fixture);
+	const auto dir = uniqueTempDirectory("comic_reader_gallery");
+	for (const auto* name : {"a.cbz", "b.cbz", "c.cbz"}) {
+		std::filesystem::copy_file(source, dir / name);
+	}
+
+	auto* frame = new wxFrame(nullptr, wxID_ANY, "");
+	auto* gallery = new ComicGallery(frame, {dir / "a.cbz", dir / "b.cbz"});
+	ASSERT_TRUE(waitForComics(*gallery, 2));
+	auto& current = gallery->currentComic();
+	EXPECT_EQ(current.path(), dir / "a.cbz");
+	// A rescanned comic would come back unloaded
+	ASSERT_TRUE(current.load());
+
+	// Only the new comic is scanned, the others are left as they are
+	gallery->changeComics({dir / "c.cbz"}, {});
+	ASSERT_TRUE(waitForComics(*gallery, 3));
+	EXPECT_EQ(&gallery->currentComic(), &current);
+	EXPECT_FALSE(current.pages.empty());
+
+	gallery->changeComics({}, {dir / "b.cbz"});
+	EXPECT_EQ(gallery->length(), 2);
+	EXPECT_EQ(&gallery->currentComic(), &current);
+	EXPECT_FALSE(current.pages.empty());
+
+	delete frame;
+	std::filesystem::remove_all(dir);
+}
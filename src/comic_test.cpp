@@ -1,11 +1,87 @@
 #include "comic.hpp"
 
 #include <benchmark/benchmark.h>
+#include <gtest/gtest.h>
 
-#define runner(X)                                                \
-	void BM_##X(benchmark::State& state) {                       \
-		for (auto _ : state) {                                   \
-			X("testdata/cover.jpg", "testdata/cover_small.jpg"); \
-		}                                                        \
-	}                                                            \
-	BENCHMARK(BM_##X);
+#include <algorithm>
+
+#include "archive.hpp"
+#include "fixtures.hpp"
+
+// Args are the page count, page format and archive format, pages are
+// 1200x1800
+ComicFixture comicFixture(const benchmark::State& state) {
+	ComicFixture fixture;
+	fixture.pages = state.range(0);
+	fixture.format = PageFormat(state.range(1));
+	fixture.archive = ArchiveFormat(state.range(2));
+	return fixture;
+}
+
+// Listing the pages and making the cover thumbnail, as the gallery does
+void BM_ComicScan(benchmark::State& state) {
+	const auto file = fixtureComic(comicFixture(state));
+	for (auto _ : state) { benchmark::DoNotOptimize(Comic(file).length()); }
+}
+BENCHMARK(BM_ComicScan)
+	->ArgNames({"pages", "format", "archive"})
+	->ArgsProduct({{16, 64}, {0, 2}, {0, 1}})
+	->Unit(benchmark::kMillisecond);
+
+// Opening a comic, `warm` ones were opened before and have a manifest.
+// Cold solid archives aren't loaded but streamed, see PagePipeline.
+void BM_ComicLoad(benchmark::State& state, bool warm) {
+	// Manifests are kept in the data directory, which needs an app name
+	if (!startWx()) {
+		state.SkipWithError("Unable to start wx");
+		return;
+	}
+	const auto file = fixtureComic(comicFixture(state));
+	Comic comic(file, 0);
+	if (warm && !comic.load()) {
+		comic.finishStream(ArchiveIndex(file).files());
+	}
+	comic.unload();
+	for (auto _ : state) {
+		if (!warm) {
+			state.PauseTiming();
+			std::filesystem::remove(getManifestPath(file));
+			state.ResumeTiming();
+		}
+		benchmark::DoNotOptimize(comic.load());
+		comic.unload();
+	}
+}
+BENCHMARK_CAPTURE(BM_ComicLoad, cold, false)
+	->ArgNames({"pages", "format", "archive"})
+	->ArgsProduct({{16, 64}, {0}, {0}});
+BENCHMARK_CAPTURE(BM_ComicLoad, warm, true)
+	->ArgNames({"pages", "format", "archive"})
+	->ArgsProduct({{16, 64}, {0}, {0, 1}});
+
+TEST(comic, SortsStreamedPages) {
+	// Manifests are kept in the data directory, which needs an app name
+	if (!startWx()) { GTEST_SKIP() << "Unable to start wx"; }
+	ComicFixture fixture;
+	fixture.pages = 12;
+	fixture.pageSize = wxSize(64, 96);
+	fixture.archive = ArchiveFormat::SevenZip;
+	const auto file = fixtureComic(fixture);
+	std::filesystem::remove(getManifestPath(file));
+
+	Comic comic(file, 0);
+	ASSERT_FALSE(comic.load());
+	auto entries = ArchiveIndex(file).files();
+	std::reverse(entries.begin(), entries.end());
+	// Every page arrives before the ones already seen
+	for (const auto& entry : entries) {
+		if (isImage(entry.path)) { EXPECT_EQ(comic.addStreamedPage(entry), 0); }
+	}
+	ASSERT_EQ(comic.length(), fixture.pages);
+	EXPECT_TRUE(
+		std::is_sorted(comic.pages.begin(), comic.pages.end(), pageOrder));
+	// Readable through the shared reader before the stream is done
+	EXPECT_FALSE(comic.readPage(comic.pages.back()).empty());
+	EXPECT_FALSE(comic.finishStream(ArchiveIndex(file).files()));
+	comic.unload();
+}
@@ -1,35 +1,152 @@
 #include "comic_viewer.hpp"
 
 #include <wx/dcbuffer.h>
+#include <wx/dcmemory.h>
 #include <wx/numdlg.h>
-#include <wx/progdlg.h>
 
-#include "fuzzy.hpp"
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <unordered_map>
+
+#include "layout.hpp"
+#include "trace.hpp"
 #include "util.hpp"
 #include "wxUtil.hpp"
 
+const int PAGE_PIPELINE_UPDATE_ID = 100002;
+
+layout::Rect toRect(const wxRect2DDouble& rect) {
+	return {rect.m_x, rect.m_y, rect.m_width, rect.m_height};
+}
+
+layout::Size toSize(const wxSize& size) {
+	return {double(size.GetWidth()), double(size.GetHeight())};
+}
+
 ComicViewer::ComicViewer(wxWindow* parent, Comic& comic)
-	: wxPanel(parent), comic(comic), index(0), animation(AnimationType::None) {
+	: wxPanel(parent),
+	  comic(comic),
+	  index(0),
+	  showEnd(false),
+	  animation(AnimationType::None),
+	  pool(this),
+	  bufferZoom(0),
+	  bufferIndex(-1),
+	  bufferValid(false),
+	  pageBitmapSlot(-1) {
 	Bind(wxEVT_PAINT, &ComicViewer::OnPaint, this);
 	Bind(wxEVT_MOUSEWHEEL, &ComicViewer::OnMouseWheel, this);
 	Bind(wxEVT_LEFT_DOWN, &ComicViewer::OnLeftDown, this);
 	Bind(wxEVT_LEFT_DCLICK, &ComicViewer::OnLeftDClick, this);
 	Bind(wxEVT_SIZE, &ComicViewer::OnSize, this);
 	Bind(wxEVT_CLOSE_WINDOW, &ComicViewer::OnClose, this);
+	Bind(
+		wxEVT_COMMAND_TEXT_UPDATED, &ComicViewer::OnImageReady, this,
+		IMAGE_POOL_UPDATE_ID);
+	Bind(
+		wxEVT_COMMAND_TEXT_UPDATED, &ComicViewer::OnPagesStreamed, this,
+		PAGE_PIPELINE_UPDATE_ID);
 	SetBackgroundStyle(wxBG_STYLE_PAINT);
 	SetBackgroundColour(wxColour(25, 25, 25));
 }
 
 void ComicViewer::load() {
-	wxProgressDialog dialog(
-		"Loading Comic", "Loading Pages", comic.length(), this);
-	comic.load([&](int i) { dialog.Update(i + 1); });
-	for (auto& page : comic.pages) { pool.addImage(page); }
+	if (!comic.load()) {
+		// Each page is shown as soon as it is decoded instead of after the
+		// whole archive has been read. Joining the budget first lets the
+		// pool keep what the pipeline decodes.
+		pool.activate();
+		pool.prefetch({});
+		pipeline = std::make_unique<PagePipeline>(comic.path(), [this]() {
+			QueueEvent(new wxCommandEvent(
+				wxEVT_COMMAND_TEXT_UPDATED, PAGE_PIPELINE_UPDATE_ID));
+		});
+		return;
+	}
+	addPages();
+	prefetch(index, index);
+}
+
+std::function<std::vector<uint8_t>()> ComicViewer::pageReader(int i) {
+	return [&comic = comic, page = comic.pages[i]]() {
+		return comic.readPage(page);
+	};
+}
+
+void ComicViewer::prefetch(int from, int to) {
+	auto wanted = navigation.onNavigate(from, to, comic.length());
+	for (auto& [i, priority] : wanted) { i = slots[i]; }
+	pool.prefetch(wanted);
+}
+
+void ComicViewer::addPages() {
+	// Pages are only extracted once the pool needs them
+	for (auto i = 0; i < comic.length(); ++i) {
+		pool.addImage(comic.pages[i], pageReader(i), comic.pageSize(i));
+		slots.push_back(i);
+	}
+}
+
+void ComicViewer::OnPagesStreamed(wxCommandEvent& event) {
+	if (!pipeline) { return; }
+	for (auto& page : pipeline->take()) {
+		const auto slot = static_cast<int>(slots.size());
+		const auto i = comic.addStreamedPage(page.entry);
+		slots.insert(slots.begin() + i, slot);
+		// Read again through the comic's reader, which keeps its place in
+		// the archive
+		pool.addImage(page.entry.path, pageReader(i), page.decoded.size);
+		pool.offer(slot, page.decoded);
+		// The page on screen stays there as pages sort in before it
+		if (comic.length() > 1 && i <= index) {
+			++index;
+			bufferValid = false;
+		}
+	}
+	if (pipeline->done()) {
+		const auto files = pipeline->files();
+		pipeline.reset();
+		std::unordered_map<std::string, int> slotOf;
+		for (auto i = 0; i < comic.length(); ++i) {
+			slotOf[comic.pages[i].string()] = slots[i];
+		}
+		const auto shown = index < comic.length() ? slots[index] : -1;
+		if (comic.finishStream(files)) {
+			// Only pages that sort as equal can have moved, the pool keeps
+			// their images
+			for (auto i = 0; i < comic.length(); ++i) {
+				slots[i] = slotOf[comic.pages[i].string()];
+			}
+			const auto it = std::find(slots.begin(), slots.end(), shown);
+			index = it == slots.end()
+						? 0
+						: static_cast<int>(it - slots.begin());
+			bufferValid = false;
+		}
+	}
+	Refresh();
 }
 
 void ComicViewer::OnClose(wxCloseEvent& event) {
-	comic.unload();
+	pipeline.reset();
+	// Remember page sizes so the next open can lay out without decoding
+	for (auto i = 0; i < comic.length(); ++i) {
+		comic.setPageSize(i, pool.knownSize(slots[i]));
+	}
+	// Joins the decode workers, which read pages through the comic
 	pool.clear();
+	slots.clear();
+	pageBitmap = wxGraphicsBitmap();
+	pageBitmapSource = wxNullBitmap;
+	pageBitmapSlot = -1;
+	comic.unload();
+}
+
+void ComicViewer::OnImageReady(wxCommandEvent& event) {
+	// A sharper decode may have arrived, the buffer can't be reused
+	bufferValid = false;
+	Refresh();
 }
 
 bool ComicViewer::verify(const wxGraphicsContext* gc, int i) {
@@ -38,48 +155,168 @@ bool ComicViewer::verify(const wxGraphicsContext* gc, int i) {
 }
 
 void ComicViewer::OnPaint(wxPaintEvent& event) {
+	TraceSpan span("ComicViewer::OnPaint", true);
+	// Created even when there is nothing to draw, which is the case while
+	// the first pages stream in. On MSW a paint handler that never
+	// validates its region is called again right away.
+	wxAutoBufferedPaintDC dc(this);
+	dc.Clear();
 	if (pool.empty()) { return; }
 	if (comic.pages.empty()) { return; }
 
-	wxAutoBufferedPaintDC dc(this);
-	dc.Clear();
+	// Whichever view is painting is the one on screen
+	pool.activate();
 
-	// direct2d renderer
-	wxGraphicsRenderer* d2dr = wxGraphicsRenderer::GetDefaultRenderer();
-	wxGraphicsContext* gc = d2dr->CreateContext(dc);
-
-	if (gc) {
-		const auto& cw = GetClientSize().GetWidth();
-		const auto& ch = GetClientSize().GetHeight();
-		const auto& iw = pool.size(index).GetWidth();
-		const auto& ih = pool.size(index).GetHeight();
+	const auto cs = GetClientSize();
+	const auto pageText =
+		std::to_string(index + 1) + "/" + std::to_string(comic.length());
 
+	// Never decode here, until the page is ready only what is known
+	// about it is drawn
+	if (!viewport.IsEmpty()) { pool.setScale(GetZoom()); }
+	const auto ready = pool.request(slots[index]);
+	if (ready || pool.knownSize(slots[index]) != wxDefaultSize) {
 		if (viewport.IsEmpty()) {
-			viewport = Viewport(0, 0, cw, ch);
+			viewport = Viewport(0, 0, cs.GetWidth(), cs.GetHeight());
 			NextZoom(wxPoint());
 			NextZoom(wxPoint());
 		}
 
+		if (showEnd) {
+			const auto ps = pageSize(index);
+			viewport.MoveRightBottomTo(
+				wxPoint2DDouble(ps.GetWidth(), ps.GetHeight()));
+			showEnd = false;
+		}
 		OptimizeViewport();
 
-		gc->SetInterpolationQuality(wxINTERPOLATION_BEST);
-
 		const auto totalPan = viewport.GetLeftTop() + inProgressPanVector;
-
 		const auto zoom = GetZoom();
+		if (animation != AnimationType::None && ready && bufferValid &&
+			bufferIndex == index && bufferZoom == zoom &&
+			backBuffer.GetSize() == cs) {
+			ScrollBuffer(totalPan);
+		} else {
+			if (backBuffer.GetSize() != cs) { backBuffer.Create(cs); }
+			DrawPage(
+				backBuffer, totalPan, ready, wxRegion(wxRect(cs)),
+				wxINTERPOLATION_BEST);
+			bufferPan = totalPan;
+			bufferZoom = zoom;
+			bufferIndex = index;
+			bufferValid = ready;
+		}
+		dc.DrawBitmap(backBuffer, 0, 0);
+	}
+
+	// direct2d renderer
+	wxGraphicsRenderer* d2dr = wxGraphicsRenderer::GetDefaultRenderer();
+	wxGraphicsContext* gc = d2dr->CreateContext(dc);
+	if (gc) {
+		// Drawn over the buffer, it never moves with the page
+		drawBottomText(pageText, gc, cs.GetWidth(), cs.GetHeight());
+		delete gc;
+	}
+}
 
+void ComicViewer::DrawPage(
+	wxBitmap& buffer, const wxPoint2DDouble& pan, bool ready,
+	const wxRegion& area, wxInterpolationQuality quality) {
+	wxMemoryDC memory(buffer);
+	wxGraphicsRenderer* d2dr = wxGraphicsRenderer::GetDefaultRenderer();
+	wxGraphicsContext* gc = d2dr->CreateContext(memory);
+	if (!gc) { return; }
+
+	gc->SetPen(*wxTRANSPARENT_PEN);
+	gc->SetBrush(wxBrush(GetBackgroundColour()));
+	gc->SetInterpolationQuality(quality);
+
+	const auto iw = pageSize(index).GetWidth();
+	const auto ih = pageSize(index).GetHeight();
+	auto shown = toRect(viewport);
+	shown.x = pan.m_x;
+	shown.y = pan.m_y;
+	const auto page = layout::pageRect(
+		shown, toSize(GetClientSize()), {double(iw), double(ih)});
+	const auto zoom = page.width / iw;
+	const auto slot = slots[index];
+
+	// Each rectangle on its own, the box of the L a diagonal pan uncovers
+	// would be most of the window
+	for (wxRegionIterator it(area); it; ++it) {
+		const auto box = it.GetRect();
+		gc->PushState();
+		gc->Clip(box.x, box.y, box.width, box.height);
+		gc->DrawRectangle(box.x, box.y, box.width, box.height);
+		gc->Translate(page.x, page.y);
 		gc->Scale(zoom, zoom);
-		gc->Translate(-totalPan.m_x, -totalPan.m_y);
 
-		gc->DrawBitmap(pool.bitmap(index), 0, 0, iw, ih);
+		if (ready && pool.tiled(slot)) {
+			// Only the tiles crossing the rectangle are loaded and drawn
+			const wxRect2DDouble tileArea(
+				(box.x - page.x) / zoom, (box.y - page.y) / zoom,
+				box.width / zoom, box.height / zoom);
+			for (const auto& [rect, tile] : pool.tilesIn(slot, tileArea)) {
+				gc->DrawBitmap(
+					tile, rect.m_x, rect.m_y, rect.m_width, rect.m_height);
+			}
+		} else if (ready) {
+			gc->DrawBitmap(PageBitmap(gc), 0, 0, iw, ih);
+		} else {
+			drawPlaceholder(gc, 0, 0, iw, ih);
+		}
+		gc->PopState();
+	}
+	delete gc;
+}
 
-		gc->Translate(totalPan.m_x, totalPan.m_y);
-		gc->Scale(1.0 / zoom, 1.0 / zoom);
-		drawBottomText(
-			std::to_string(index + 1) + "/" + std::to_string(comic.length()),
-			gc, cw, ch);
-		delete gc;
+const wxGraphicsBitmap& ComicViewer::PageBitmap(wxGraphicsContext* gc) {
+	const auto slot = slots[index];
+	const auto& bitmap = pool.bitmap(slot);
+	if (pageBitmapSlot != slot || !pageBitmapSource.IsSameAs(bitmap)) {
+		pageBitmap = gc->CreateBitmap(bitmap);
+		pageBitmapSource = bitmap;
+		pageBitmapSlot = slot;
 	}
+	return pageBitmap;
+}
+
+void ComicViewer::ScrollBuffer(const wxPoint2DDouble& pan) {
+	const auto cs = GetClientSize();
+	// Shifted by whole pixels, the pan the buffer shows is adjusted to match.
+	// The drift stays under a pixel and goes with the redraw after panning.
+	const int dx = std::lround((bufferPan.m_x - pan.m_x) * bufferZoom);
+	const int dy = std::lround((bufferPan.m_y - pan.m_y) * bufferZoom);
+	if (dx == 0 && dy == 0) { return; }
+	bufferPan -= wxPoint2DDouble(dx, dy) / bufferZoom;
+	if (std::abs(dx) >= cs.GetWidth() || std::abs(dy) >= cs.GetHeight()) {
+		DrawPage(
+			backBuffer, bufferPan, true, wxRegion(wxRect(cs)),
+			wxINTERPOLATION_FAST);
+		return;
+	}
+
+	if (scrollBuffer.GetSize() != cs) { scrollBuffer.Create(cs); }
+	{
+		wxMemoryDC from(backBuffer), to(scrollBuffer);
+		to.Blit(dx, dy, cs.GetWidth(), cs.GetHeight(), &from, 0, 0);
+	}
+	std::swap(backBuffer, scrollBuffer);
+
+	// Only the strips the shift uncovered are drawn, at a quality that
+	// keeps up with the pointer
+	wxRegion uncovered;
+	if (dx > 0) {
+		uncovered.Union(0, 0, dx, cs.GetHeight());
+	} else if (dx < 0) {
+		uncovered.Union(cs.GetWidth() + dx, 0, -dx, cs.GetHeight());
+	}
+	if (dy > 0) {
+		uncovered.Union(0, 0, cs.GetWidth(), dy);
+	} else if (dy < 0) {
+		uncovered.Union(0, cs.GetHeight() + dy, cs.GetWidth(), -dy);
+	}
+	DrawPage(backBuffer, bufferPan, true, uncovered, wxINTERPOLATION_FAST);
 }
 
 void ComicViewer::OnSize(wxSizeEvent& event) {
@@ -101,7 +338,7 @@ void ComicViewer::OnSize(wxSizeEvent& event) {
 }
 
 void ComicViewer::HandleInput(Navigation input) {
-	if (animation != AnimationType::None) { return; }
+	if (animation != AnimationType::None || comic.pages.empty()) { return; }
 	auto dir = Navigation::NoOp;
 	wxPoint2DDouble delta;
 	auto nextIndex = index;
@@ -116,14 +353,13 @@ void ComicViewer::HandleInput(Navigation input) {
 			break;
 	}
 
-	const auto& is =
-		wxPoint2DDouble(pool.size(index).GetX(), pool.size(index).GetY());
-
 	if (dir == Navigation::NextPage) {
 		nextIndex = std::min(index + 1, comic.length() - 1);
 	} else if (dir == Navigation::PreviousPage) {
 		nextIndex = std::max(index - 1, 0);
 	} else if (dir == Navigation::JumpToPage) {
+		// Whatever was predicted is stale now
+		pool.cancelPrefetch();
 		nextIndex = wxGetNumberFromUser(
 						"Go To Page", "", "", index + 1, 1, comic.length()) -
 					1;
@@ -131,13 +367,11 @@ void ComicViewer::HandleInput(Navigation input) {
 	}
 
 	if (index != nextIndex) {
-		if (nextIndex > index) {
-			viewport.MoveLeftTopTo({0, 0});
-		} else {
-			const auto ns = pool.size(nextIndex);
-			viewport.MoveRightBottomTo(
-				wxPoint2DDouble(ns.GetWidth(), ns.GetHeight()));
-		}
+		// The end of the previous page is found when it is painted, its
+		// size may not be known yet
+		viewport.MoveLeftTopTo({0, 0});
+		showEnd = nextIndex < index;
+		prefetch(index, nextIndex);
 		index = nextIndex;
 		Refresh();
 	} else if (dir == Navigation::PreviousView || dir == Navigation::NextView) {
@@ -150,64 +384,37 @@ void ComicViewer::HandleInput(Navigation input) {
 	}
 }
 
+wxSize ComicViewer::pageSize(int i) {
+	// Known from the manifest or an earlier decode
+	const auto& known = pool.knownSize(slots[i]);
+	if (known != wxDefaultSize) { return known; }
+	// Otherwise the page fills the window at the current zoom, so the
+	// layout holds still until the decode lands
+	if (viewport.IsEmpty()) { return GetClientSize(); }
+	return wxSize(std::lround(viewport.W()), std::lround(viewport.H()));
+}
+
 std::pair<Navigation, wxPoint2DDouble> ComicViewer::ComputeMove(
 	Navigation direction) {
-	const auto iw = pool.size(index).GetWidth();
-	const auto ih = pool.size(index).GetHeight();
+	const auto page = toSize(pageSize(index));
+	layout::Move move;
 	if (direction == Navigation::NextView) {
-		if (fuzzy::greater_equal(viewport.GetRight(), iw) &&
-			fuzzy::greater_equal(viewport.GetBottom(), ih)) {
-			return {Navigation::NextPage, {}};
-		}
-		if (fuzzy::less(viewport.GetRight(), iw)) {
-			return {
-				Navigation::NextView,
-				{std::min(viewport.W() / 2, iw - viewport.GetRight()), 0}};
-		}
-		return {
-			Navigation::NextView,
-			{-std::max(0.0, iw - viewport.W()),
-			 std::min(viewport.H() / 2, ih - viewport.GetBottom())}};
+		move = layout::nextView(toRect(viewport), page);
 	} else if (direction == Navigation::PreviousView) {
-		if (fuzzy::less_equal(viewport.GetLeft(), 0) &&
-			fuzzy::less_equal(viewport.GetTop(), 0)) {
-			return {Navigation::PreviousPage, {}};
-		}
-		if (fuzzy::greater(viewport.GetLeft(), 0)) {
-			return {
-				Navigation::PreviousView,
-				{-std::min(viewport.W() / 2, viewport.GetLeft()), 0}};
-		}
-		return {
-			Navigation::PreviousView,
-			{std::max(0.0, iw - viewport.W()),
-			 -std::min(viewport.H() / 2, viewport.GetTop())}};
+		move = layout::previousView(toRect(viewport), page);
+	} else {
+		return {Navigation::NoOp, {}};
 	}
-	return {Navigation::NoOp, {}};
+	if (move.page > 0) { return {Navigation::NextPage, {}}; }
+	if (move.page < 0) { return {Navigation::PreviousPage, {}}; }
+	return {direction, {move.delta.x, move.delta.y}};
 }
 
 void ComicViewer::NextZoom(const wxPoint& pt) {
-	auto cs = GetClientSize();
+	if (comic.pages.empty()) { return; }
 	auto currentZoom = GetZoom();
-
-	std::vector<double> validZooms = {
-		double(cs.GetWidth()) / pool.size(index).GetWidth(),
-		double(cs.GetHeight()) / pool.size(index).GetHeight(),
-		1.0,
-	};
-	std::sort(validZooms.begin(), validZooms.end());
-
-	auto nextZoom = validZooms[0];
-
-	for (auto z : validZooms) {
-		bool isLess = currentZoom < z;
-		bool isAlmostEqual = std::fabs(currentZoom - z) <= 0.001;
-		if (isLess && !isAlmostEqual) {
-			nextZoom = z;
-			break;
-		}
-	}
-
+	const auto nextZoom = layout::nextZoom(
+		currentZoom, toSize(GetClientSize()), toSize(pageSize(index)));
 	viewport.ScaleAtPoint(MapClientToViewport(pt), currentZoom / nextZoom);
 	Refresh();
 }
@@ -226,33 +433,9 @@ wxPoint2DDouble ComicViewer::MapClientToViewport(const wxPoint& pt) {
 }
 
 void ComicViewer::OptimizeViewport() {
-	const auto& vs = viewport.GetSize();
-	const auto& is = pool.size(index);
-
-	// If there is extra space in both directions, scale viewport down to
-	// closest edge
-	if (vs.GetWidth() > is.GetWidth() && vs.GetHeight() > is.GetHeight()) {
-		auto widthScale = double(is.GetWidth()) / vs.GetWidth();
-		auto heightScale = double(is.GetHeight()) / vs.GetHeight();
-		viewport.ScaleAtPoint(
-			viewport.GetCentre(), std::max(widthScale, heightScale));
-	}
-
-	if (vs.GetWidth() > is.GetWidth()) {
-		viewport.SetCentre({is.GetWidth() / 2.0, viewport.GetCentre().m_y});
-	} else if (viewport.GetLeft() < 0) {
-		viewport.Translate(-viewport.GetLeft(), 0);
-	} else if (viewport.GetRight() > is.x) {
-		viewport.Translate((is.x - viewport.GetRight()), 0);
-	}
-
-	if (vs.GetHeight() > is.GetHeight()) {
-		viewport.SetCentre({viewport.GetCentre().m_x, is.GetHeight() / 2.0});
-	} else if (viewport.GetTop() < 0) {
-		viewport.Translate(0, -viewport.GetTop());
-	} else if (viewport.GetBottom() > is.y) {
-		viewport.Translate(0, (is.y - viewport.GetBottom()));
-	}
+	const auto fitted =
+		layout::fitViewport(toRect(viewport), toSize(pageSize(index)));
+	viewport = Viewport(fitted.x, fitted.y, fitted.width, fitted.height);
 }
 
 void ComicViewer::OnMouseWheel(wxMouseEvent& event) {
@@ -0,0 +1,159 @@
+#include "fixtures.hpp"
+
+#include <archive.h>
+#include <archive_entry.h>
+#include <webp/encode.h>
+#include <wx/app.h>
+#include <wx/init.h>
+#include <wx/mstream.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+std::filesystem::path fixtureDirectory() {
+	const auto dir =
+		std::filesystem::temp_directory_path() / "comic_reader_fixtures";
+	std::filesystem::create_directories(dir);
+	return dir;
+}
+
+std::filesystem::path uniqueTempDirectory(const std::string& prefix) {
+	// create_directory fails when the name is already taken
+	std::random_device seed;
+	std::filesystem::path dir;
+	do {
+		dir = std::filesystem::temp_directory_path() /
+			  (prefix + "_" + std::to_string(seed()));
+	} while (!std::filesystem::create_directory(dir));
+	return dir;
+}
+
+std::string extension(PageFormat format) {
+	switch (format) {
+		case PageFormat::Jpeg:
+			return ".jpg";
+		case PageFormat::Png:
+			return ".png";
+		case PageFormat::WebP:
+			return ".webp";
+	}
+	return "";
+}
+
+wxImage syntheticPage(const wxSize& size, int seed) {
+	wxInitAllImageHandlers();
+	std::mt19937 gen(seed);
+	std::uniform_int_distribution<int> grain(-12, 12);
+	wxImage page(size, false);
+	auto* data = page.GetData();
+	const auto w = size.GetWidth(), h = size.GetHeight();
+	for (int y = 0; y < h; ++y) {
+		for (int x = 0; x < w; ++x, data += 3) {
+			const auto g = grain(gen);
+			data[0] = uint8_t(std::clamp(x * 255 / w + g, 0, 255));
+			data[1] = uint8_t(std::clamp(y * 255 / h + g, 0, 255));
+			const auto pattern = (seed * 40 + (x ^ y)) % 256;
+			data[2] = uint8_t(std::clamp(pattern + g, 0, 255));
+		}
+	}
+	return page;
+}
+
+std::vector<uint8_t> encodePage(const wxImage& page, PageFormat format) {
+	if (format == PageFormat::WebP) {
+		uint8_t* bytes;
+		const auto size = WebPEncodeRGB(
+			page.GetData(), page.GetWidth(), page.GetHeight(),
+			page.GetWidth() * 3, 85, &bytes);
+		std::vector<uint8_t> content(bytes, bytes + size);
+		WebPFree(bytes);
+		return content;
+	}
+	wxMemoryOutputStream stream;
+	page.SaveFile(
+		stream, format == PageFormat::Png ? wxBITMAP_TYPE_PNG
+										  : wxBITMAP_TYPE_JPEG);
+	std::vector<uint8_t> content(stream.GetSize());
+	stream.CopyTo(content.data(), content.size());
+	return content;
+}
+
+std::filesystem::path fixturePage(PageFormat format, const wxSize& size) {
+	const auto file =
+		fixtureDirectory() / ("page_" + std::to_string(size.GetWidth()) +
+							  "x" + std::to_string(size.GetHeight()) +
+							  extension(format));
+	if (std::filesystem::exists(file)) { return file; }
+	const auto content = encodePage(syntheticPage(size, 0), format);
+	std::ofstream(file, std::ios::binary)
+		.write(reinterpret_cast<const char*>(content.data()), content.size());
+	return file;
+}
+
+std::filesystem::path fixtureComic(const ComicFixture& fixture) {
+	const auto& size = fixture.pageSize;
+	const auto file =
+		fixtureDirectory() /
+		("comic_" + std::to_string(fixture.pages) + "_" +
+		 std::to_string(size.GetWidth()) + "x" +
+		 std::to_string(size.GetHeight()) + "_" +
+		 extension(fixture.format).substr(1) +
+		 (fixture.archive == ArchiveFormat::Zip ? ".cbz" : ".cb7"));
+	if (std::filesystem::exists(file)) { return file; }
+
+	// A few distinct pages, so solid compression can't fold them together
+	std::vector<std::vector<uint8_t>> pages;
+	for (int seed = 0; seed < std::min(fixture.pages, 4); ++seed) {
+		pages.push_back(
+			encodePage(syntheticPage(size, seed), fixture.format));
+	}
+
+	// Written next to the fixture and renamed, so an interrupted run never
+	// leaves a truncated one behind
+	const auto partial = file.string() + ".partial";
+	auto archive = archive_write_new();
+	if (fixture.archive == ArchiveFormat::Zip) {
+		archive_write_set_format_zip(archive);
+		// Like most CBZ files, the pages are compressed already
+		archive_write_set_options(archive, "zip:compression=store");
+	} else {
+		archive_write_set_format_7zip(archive);
+	}
+	if (archive_write_open_filename(archive, partial.c_str()) != ARCHIVE_OK) {
+		const std::string error = archive_error_string(archive);
+		archive_write_free(archive);
+		throw std::runtime_error("Unable to write fixture: " + error);
+	}
+	for (int i = 0; i < fixture.pages; ++i) {
+		const auto& content = pages[i % pages.size()];
+		char name[32];
+		std::snprintf(name, sizeof(name), "page_%04d", i);
+		auto entry = archive_entry_new();
+		archive_entry_set_pathname(
+			entry, (name + extension(fixture.format)).c_str());
+		archive_entry_set_size(entry, content.size());
+		archive_entry_set_filetype(entry, AE_IFREG);
+		archive_entry_set_perm(entry, 0644);
+		archive_write_header(archive, entry);
+		archive_write_data(archive, content.data(), content.size());
+		archive_entry_free(entry);
+	}
+	archive_write_close(archive);
+	archive_write_free(archive);
+	std::filesystem::rename(partial, file);
+	return file;
+}
+
+bool startWx() {
+	static const bool started = []() {
+		static wxChar name[] = wxT("benchmarks");
+		static wxChar* argv[] = {name, nullptr};
+		int argc = 1;
+		wxApp::SetInstance(new wxApp());
+		return wxEntryStart(argc, argv) && wxTheApp->CallOnInit();
+	}();
+	return started;
+}
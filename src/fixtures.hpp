@@ -0,0 +1,43 @@
+#pragma once
+
+#include <wx/gdicmn.h>
+#include <wx/image.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Synthetic comics for the benchmarks, written once per configuration to
+// the temp directory and reused by later runs
+
+enum class PageFormat { Jpeg, Png, WebP };
+// libarchive can't write RAR, solid 7z stands in for CBR
+enum class ArchiveFormat { Zip, SevenZip };
+
+std::string extension(PageFormat format);
+
+// Scan like noise over gradients, compresses about as well as real pages
+wxImage syntheticPage(const wxSize& size, int seed);
+
+std::vector<uint8_t> encodePage(const wxImage& page, PageFormat format);
+
+// A single page written as an image file
+std::filesystem::path fixturePage(PageFormat format, const wxSize& size);
+
+struct ComicFixture {
+	int pages = 16;
+	wxSize pageSize = wxSize(1200, 1800);
+	PageFormat format = PageFormat::Jpeg;
+	ArchiveFormat archive = ArchiveFormat::Zip;
+};
+
+std::filesystem::path fixtureComic(const ComicFixture& fixture);
+
+// New empty directory in the temp directory, named `prefix` with a random
+// suffix so concurrent runs don't collide. The caller removes it.
+std::filesystem::path uniqueTempDirectory(const std::string& prefix);
+
+// Starts wx with a GUI for code that needs an app or bitmaps, false when
+// there is no display to start it on
+bool startWx();
@@ -0,0 +1,63 @@
+#include "frame_clock.hpp"
+
+#include <wx/display.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+const int DEFAULT_REFRESH_RATE = 60;
+
+FrameClock::FrameClock(int intervalMs) : nextId(0), intervalMs(intervalMs) {
+	timer.SetOwner(this);
+	Bind(wxEVT_TIMER, &FrameClock::OnTimer, this);
+}
+
+FrameClock& FrameClock::get() {
+	// Never destroyed, wx may already be shut down at exit
+	static auto* clock = new FrameClock(frameInterval(
+		std::getenv("COMIC_READER_FPS"),
+		wxDisplay(0u).GetCurrentMode().refresh));
+	return *clock;
+}
+
+int FrameClock::add(Tick tick) {
+	const auto id = nextId++;
+	ticks[id] = std::move(tick);
+	if (!timer.IsRunning()) { timer.Start(intervalMs); }
+	return id;
+}
+
+void FrameClock::remove(int id) {
+	ticks.erase(id);
+	if (ticks.empty()) { timer.Stop(); }
+}
+
+void FrameClock::OnTimer(wxTimerEvent& event) {
+	const auto now = std::chrono::steady_clock::now();
+	// Subscribers may come and go while ticking, only those present before
+	// and still present are stepped
+	std::vector<int> ids;
+	ids.reserve(ticks.size());
+	for (const auto& [id, tick] : ticks) { ids.push_back(id); }
+	for (const auto id : ids) {
+		const auto it = ticks.find(id);
+		if (it == ticks.end()) { continue; }
+		// Copied, a tick removing itself would destroy the one running
+		const auto tick = it->second;
+		tick(now);
+	}
+}
+
+int frameInterval(const char* override, int refreshRate) {
+	auto rate = refreshRate > 0 ? refreshRate : DEFAULT_REFRESH_RATE;
+	if (override != nullptr) {
+		try {
+			const auto cap = std::stoi(override);
+			if (cap > 0) { rate = std::min(rate, cap); }
+		} catch (const std::exception&) {
+		}
+	}
+	return std::max(1000 / rate, 1);
+}
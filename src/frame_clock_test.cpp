@@ -0,0 +1,16 @@
+#include "frame_clock.hpp"
+
+#include <gtest/gtest.h>
+
+TEST(frameClock, Interval) {
+	EXPECT_EQ(frameInterval(nullptr, 60), 16);
+	EXPECT_EQ(frameInterval(nullptr, 144), 6);
+	// Unknown rates fall back to 60 Hz
+	EXPECT_EQ(frameInterval(nullptr, 0), 16);
+	// Only ever lowers the rate
+	EXPECT_EQ(frameInterval("30", 60), 33);
+	EXPECT_EQ(frameInterval("240", 60), 16);
+	EXPECT_EQ(frameInterval("junk", 60), 16);
+	EXPECT_EQ(frameInterval("0", 60), 16);
+	EXPECT_EQ(frameInterval(nullptr, 2000), 1);
+}
@@ -1,56 +1,354 @@
 #include "image_utils.hpp"
 
+#include <turbojpeg.h>
 #include <webp/decode.h>
 #include <webp/encode.h>
 #include <wx/bitmap.h>
+#include <wx/log.h>
+#include <wx/mstream.h>
 
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
 
 #include "archive.hpp"
+#include "comic.hpp"
+#include "mapped_file.hpp"
+#include "memory_budget.hpp"
+#include "resample.hpp"
+#include "trace.hpp"
 #include "util.hpp"
 
-bool save(const std::filesystem::path& file, const wxImage& img) {
-	if (file.extension() != ".webp") { return img.SaveFile(file.string()); }
+// Encode in the format given by the extension of `file`
+std::vector<uint8_t> encode(
+	const wxImage& img, const std::filesystem::path& file) {
+	if (file.extension() != ".webp") {
+		auto handler = wxImage::FindHandler(
+			file.extension().string().substr(1), wxBITMAP_TYPE_ANY);
+		wxMemoryOutputStream stream;
+		if (handler == nullptr || !img.SaveFile(stream, handler->GetType())) {
+			return {};
+		}
+		std::vector<uint8_t> content(stream.GetSize());
+		stream.CopyTo(content.data(), content.size());
+		return content;
+	}
 	uint8_t* bytes;
 	auto size = WebPEncodeLosslessRGB(
 		img.GetData(), img.GetWidth(), img.GetHeight(), img.GetWidth() * 3,
 		&bytes);
-	if (size == 0) { return false; }
+	if (size == 0) { return {}; }
+	std::vector<uint8_t> content(bytes, bytes + size);
+	WebPFree(bytes);
+	return content;
+}
+
+bool save(const std::filesystem::path& file, const wxImage& img) {
+	if (file.extension() != ".webp") { return img.SaveFile(file.string()); }
+	const auto content = encode(img, file);
+	if (content.empty()) { return false; }
 	std::basic_ofstream<uint8_t, std::char_traits<uint8_t>> output(
 		file, std::ios::binary);
-	output.write(bytes, size);
-	WebPFree(bytes);
+	output.write(content.data(), content.size());
 	output.close();
 	return true;
 }
 
-wxImage load(const std::filesystem::path& file) {
-	if (file.extension() != ".webp") {
-		return wxImage(file.string(), wxBITMAP_TYPE_ANY);
+// Raw thumbnails are the width and height as native uint32 followed by the
+// RGB pixels
+const char* RAW_EXTENSION = ".rgb";
+const size_t RAW_HEADER = 2 * sizeof(uint32_t);
+
+std::vector<uint8_t> encodeRaw(const wxImage& img) {
+	const uint32_t dims[2] = {
+		static_cast<uint32_t>(img.GetWidth()),
+		static_cast<uint32_t>(img.GetHeight())};
+	const auto pixels = size_t(dims[0]) * dims[1] * 3;
+	std::vector<uint8_t> content(RAW_HEADER + pixels);
+	std::memcpy(content.data(), dims, RAW_HEADER);
+	std::memcpy(content.data() + RAW_HEADER, img.GetData(), pixels);
+	return content;
+}
+
+wxImage loadRaw(const uint8_t* data, size_t size) {
+	uint32_t dims[2];
+	if (size < RAW_HEADER) { return wxImage(); }
+	std::memcpy(dims, data, RAW_HEADER);
+	const auto pixels = size_t(dims[0]) * dims[1] * 3;
+	if (dims[0] == 0 || dims[1] == 0 || size - RAW_HEADER != pixels) {
+		return wxImage();
 	}
-	std::basic_ifstream<uint8_t, std::char_traits<uint8_t>> input(
-		file, std::ios::binary);
-	std::vector<uint8_t> bytes(
-		(std::istreambuf_iterator<uint8_t>(input)),
-		std::istreambuf_iterator<uint8_t>());
-	input.close();
+	wxImage img(dims[0], dims[1], false);
+	std::memcpy(img.GetData(), data + RAW_HEADER, pixels);
+	return img;
+}
 
+// Lossy WebP, `method` trades encoding time for size
+std::vector<uint8_t> encodeWebP(
+	const wxImage& img, const ThumbnailFormat& format) {
+	WebPConfig config;
+	WebPPicture picture;
+	if (!WebPConfigPreset(&config, WEBP_PRESET_PICTURE, format.quality) ||
+		!WebPPictureInit(&picture)) {
+		return {};
+	}
+	config.method = std::clamp(format.method, 0, 6);
+	picture.width = img.GetWidth();
+	picture.height = img.GetHeight();
+	WebPMemoryWriter writer;
+	WebPMemoryWriterInit(&writer);
+	picture.writer = WebPMemoryWrite;
+	picture.custom_ptr = &writer;
+	std::vector<uint8_t> content;
+	if (WebPPictureImportRGB(&picture, img.GetData(), img.GetWidth() * 3) &&
+		WebPEncode(&config, &picture)) {
+		content.assign(writer.mem, writer.mem + writer.size);
+	}
+	WebPPictureFree(&picture);
+	WebPMemoryWriterClear(&writer);
+	return content;
+}
+
+wxImage loadImage(
+	const uint8_t* data, size_t size, const std::filesystem::path& file) {
+	if (file.extension() == RAW_EXTENSION) { return loadRaw(data, size); }
+	if (file.extension() != ".webp") {
+		wxMemoryInputStream stream(data, size);
+		return wxImage(stream, wxBITMAP_TYPE_ANY);
+	}
+	// Decoded straight into the image's own buffer, alpha is dropped as
+	// wxImage keeps it in a separate plane
 	int iw = 0;
 	int ih = 0;
-	auto pixels = WebPDecodeRGB(bytes.data(), bytes.size(), &iw, &ih);
-	wxImage img(iw, ih);
-	std::memcpy(img.GetData(), pixels, iw * ih * 3);
-	WebPFree(pixels);
+	if (!WebPGetInfo(data, size, &iw, &ih)) { return wxImage(); }
+	wxImage img(iw, ih, false);
+	const auto bytes = static_cast<size_t>(iw) * ih * 3;
+	if (WebPDecodeRGBInto(data, size, img.GetData(), bytes, iw * 3) ==
+		nullptr) {
+		return wxImage();
+	}
 	return img;
 }
 
+wxImage loadImage(const std::filesystem::path& file) {
+	if (file.extension() != ".webp") {
+		return wxImage(file.string(), wxBITMAP_TYPE_ANY);
+	}
+	try {
+		const MappedFile mapping(file);
+		return loadImage(mapping.data(), mapping.size(), file);
+	} catch (const std::filesystem::filesystem_error&) {
+		return wxImage();
+	}
+}
+
+// wxImage takes ownership of malloc'ed pixels
+wxImage fromPixels(int w, int h, unsigned char* pixels) {
+	return wxImage(w, h, pixels);
+}
+
+// DCT domain scaling, libjpeg-turbo only decodes what the output needs
+wxImage loadJpeg(
+	const uint8_t* data, size_t size, int level, wxSize& native) {
+	auto handle = tjInitDecompress();
+	if (handle == nullptr) { return wxImage(); }
+	wxImage image;
+	int w = 0, h = 0, subsampling = 0, colorspace = 0;
+	// CMYK can't be converted to RGB here, wx handles it instead
+	if (tjDecompressHeader3(
+			handle, data, size, &w, &h, &subsampling, &colorspace) == 0 &&
+		colorspace != TJCS_CMYK && colorspace != TJCS_YCCK) {
+		const tjscalingfactor factor = {1, 1 << level};
+		const auto sw = TJSCALED(w, factor), sh = TJSCALED(h, factor);
+		auto pixels = static_cast<unsigned char*>(
+			std::malloc(static_cast<size_t>(sw) * sh * 3));
+		if (pixels != nullptr &&
+			(tjDecompress2(
+				 handle, data, size, pixels, sw, 0, sh, TJPF_RGB, 0) == 0 ||
+			 tjGetErrorCode(handle) == TJERR_WARNING)) {
+			native = wxSize(w, h);
+			image = fromPixels(sw, sh, pixels);
+		} else {
+			std::free(pixels);
+		}
+	}
+	tjDestroy(handle);
+	return image;
+}
+
+wxImage loadWebP(
+	const uint8_t* data, size_t size, int level, wxSize& native) {
+	WebPDecoderConfig config;
+	if (!WebPInitDecoderConfig(&config) ||
+		WebPGetFeatures(data, size, &config.input) != VP8_STATUS_OK) {
+		return wxImage();
+	}
+	const auto w = config.input.width, h = config.input.height;
+	const auto sw = std::max(1, w >> level), sh = std::max(1, h >> level);
+	if (sw != w || sh != h) {
+		config.options.use_scaling = 1;
+		config.options.scaled_width = sw;
+		config.options.scaled_height = sh;
+	}
+	const auto bytes = static_cast<size_t>(sw) * sh * 3;
+	auto pixels = static_cast<unsigned char*>(std::malloc(bytes));
+	if (pixels == nullptr) { return wxImage(); }
+	config.output.colorspace = MODE_RGB;
+	config.output.is_external_memory = 1;
+	config.output.u.RGBA.rgba = pixels;
+	config.output.u.RGBA.stride = sw * 3;
+	config.output.u.RGBA.size = bytes;
+	if (WebPDecode(data, size, &config) != VP8_STATUS_OK) {
+		std::free(pixels);
+		return wxImage();
+	}
+	native = wxSize(w, h);
+	return fromPixels(sw, sh, pixels);
+}
+
+DecodedImage decodeImage(
+	const uint8_t* data, size_t size, const std::filesystem::path& name,
+	int level) {
+	DecodedImage decoded;
+	decoded.level = std::clamp(level, 0, MAX_DECODE_LEVEL);
+	const auto ext = name.extension();
+	if (ext == ".jpg" || ext == ".jpeg") {
+		decoded.image = loadJpeg(data, size, decoded.level, decoded.size);
+	} else if (ext == ".webp") {
+		decoded.image = loadWebP(data, size, decoded.level, decoded.size);
+	}
+	if (decoded.image.IsOk()) { return decoded; }
+
+	// Formats without scaled decoding are shrunk after a full decode, which
+	// still saves the memory
+	decoded.image = loadImage(data, size, name);
+	if (!decoded.image.IsOk()) { return decoded; }
+	decoded.size = decoded.image.GetSize();
+	const auto factor = 1 << decoded.level;
+	if (factor > decoded.size.GetWidth() ||
+		factor > decoded.size.GetHeight()) {
+		decoded.level = 0;
+	} else if (factor > 1) {
+		decoded.image = decoded.image.ShrinkBy(factor, factor);
+	}
+	return decoded;
+}
+
+DecodedImage decodeImage(
+	const std::vector<uint8_t>& content, const std::filesystem::path& name,
+	int level) {
+	return decodeImage(content.data(), content.size(), name, level);
+}
+
+// Resize `channels` interleaved channels, big reductions are boxed down to
+// twice the target first so Lanczos only needs a few taps
+void resizePlane(
+	const uint8_t* src, int sw, int sh, uint8_t* dst, int dw, int dh,
+	int channels) {
+	std::vector<uint8_t> reduced;
+	if (sw >= 4 * dw && sh >= 4 * dh) {
+		reduced.resize(size_t(2 * dw) * 2 * dh * channels);
+		resample(
+			src, sw, sh, reduced.data(), 2 * dw, 2 * dh, channels,
+			ResampleFilter::Box);
+		src = reduced.data();
+		sw = 2 * dw;
+		sh = 2 * dh;
+	}
+	resample(src, sw, sh, dst, dw, dh, channels, ResampleFilter::Lanczos3);
+}
+
+wxImage resizeImage(const wxImage& image, int width, int height) {
+	wxImage resized(width, height, false);
+	const auto sw = image.GetWidth(), sh = image.GetHeight();
+	resizePlane(image.GetData(), sw, sh, resized.GetData(), width, height, 3);
+	if (image.HasAlpha()) {
+		resized.SetAlpha();
+		resizePlane(
+			image.GetAlpha(), sw, sh, resized.GetAlpha(), width, height, 1);
+	}
+	return resized;
+}
+
+ThumbnailFormat thumbnailFormat(const char* spec) {
+	ThumbnailFormat format;
+	if (spec == nullptr) { return format; }
+	std::vector<std::string> parts;
+	std::string part;
+	for (std::istringstream stream(spec); std::getline(stream, part, ':');) {
+		parts.push_back(part);
+	}
+	if (parts.empty()) { return format; }
+	if (parts[0] == "raw") {
+		format.codec = ThumbnailCodec::Raw;
+	} else if (parts[0] == "original") {
+		format.codec = ThumbnailCodec::Original;
+	} else if (parts[0] == "webp") {
+		try {
+			if (parts.size() > 1) {
+				format.quality = std::clamp(std::stoi(parts[1]), 0, 100);
+			}
+			if (parts.size() > 2) {
+				format.method = std::clamp(std::stoi(parts[2]), 0, 6);
+			}
+		} catch (const std::exception&) {
+			return ThumbnailFormat();
+		}
+	}
+	return format;
+}
+
+Thumbnail makeThumbnail(
+	const std::vector<uint8_t>& content, const std::filesystem::path& name,
+	const int MAX_DIM, const ThumbnailFormat& format) {
+	TraceSpan span("makeThumbnail");
+	Thumbnail thumbnail;
+	thumbnail.extension = name.extension().string();
+	auto img = loadImage(content.data(), content.size(), name);
+	if (!img.IsOk()) { return thumbnail; }
+
+	int W = MAX_DIM, H = MAX_DIM;
+	if ((std::max)(img.GetWidth(), img.GetHeight()) < MAX_DIM) {
+		thumbnail.width = img.GetWidth();
+		thumbnail.height = img.GetHeight();
+		thumbnail.content = content;
+		return thumbnail;
+	} else if (img.GetWidth() > img.GetHeight()) {
+		H = (img.GetHeight() * MAX_DIM) / img.GetWidth();
+	} else {
+		W = (img.GetWidth() * MAX_DIM) / img.GetHeight();
+	}
+	thumbnail.width = W;
+	thumbnail.height = H;
+	const auto resized = resizeImage(img, W, H);
+	switch (format.codec) {
+		case ThumbnailCodec::Original:
+			thumbnail.content = encode(resized, name);
+			break;
+		case ThumbnailCodec::WebP:
+			thumbnail.extension = ".webp";
+			thumbnail.content = encodeWebP(resized, format);
+			break;
+		case ThumbnailCodec::Raw:
+			thumbnail.extension = RAW_EXTENSION;
+			thumbnail.content = encodeRaw(resized);
+			break;
+	}
+	return thumbnail;
+}
+
 bool saveThumbnail(
 	const std::filesystem::path& src, const std::filesystem::path& dest,
 	const int MAX_DIM) {
 	if (!std::filesystem::exists(src)) { return false; }
-	auto img = load(src);
+	auto img = loadImage(src);
 
 	int W = MAX_DIM, H = MAX_DIM;
 	if ((std::max)(img.GetWidth(), img.GetHeight()) < MAX_DIM) {
@@ -64,7 +362,7 @@ bool saveThumbnail(
 	} else {
 		W = (img.GetWidth() * MAX_DIM) / img.GetHeight();
 	}
-	return save(dest, img.Rescale(W, H, wxIMAGE_QUALITY_HIGH));
+	return save(dest, resizeImage(img, W, H));
 }
 
 bool isImage(const std::filesystem::path& file) {
@@ -73,42 +371,399 @@ bool isImage(const std::filesystem::path& file) {
 		   ext == ".gif";
 }
 
-ImagePool::ImagePool() : lru(1024 * 1024 * 200, 3) {  // Limit to ~200 MB
-	lru.addEvictionHook([this](int i) { unload(i); });
+// Images on screen are decoded before anything prefetched
+const int REQUEST_PRIORITY = std::numeric_limits<int>::max();
+
+// LRU key of a whole image, or of one of its tiles
+uint64_t lruKey(int index, int tile = -1) {
+	return (static_cast<uint64_t>(index) << 32) |
+		   static_cast<uint32_t>(tile + 1);
+}
+
+// Decodes in flight are only weighed against the budget once they finish,
+// so there are never many of them
+const unsigned int MAX_DECODE_WORKERS = 4;
+
+ImagePool::ImagePool(wxEvtHandler* owner, unsigned int workers)
+	: lru(0, 3),
+	  owner(owner),
+	  budgetId(-1),
+	  level(0),
+	  prefetchBudget(0),
+	  workers(workers) {
+	if (this->workers == 0) {
+		this->workers = std::clamp(
+			std::thread::hardware_concurrency(), 1u, MAX_DECODE_WORKERS);
+	}
+	lru.addEvictionHook([this](uint64_t key) {
+		const auto index = static_cast<int>(key >> 32);
+		const auto tile = static_cast<int>(key & 0xFFFFFFFF) - 1;
+		if (tile < 0) {
+			unload(index);
+		} else {
+			unloadTile(index, tile);
+		}
+	});
+}
+
+ImagePool::~ImagePool() { leaveBudget(); }
+
+void ImagePool::joinBudget() {
+	if (budgetId >= 0) { return; }
+	budgetId = MemoryBudget::get().add(
+		[this](unsigned long long bytes) { lru.setCapacity(bytes); });
+}
+
+void ImagePool::leaveBudget() {
+	if (budgetId < 0) { return; }
+	MemoryBudget::get().remove(budgetId);
+	budgetId = -1;
+}
+
+void ImagePool::activate() {
+	joinBudget();
+	MemoryBudget::get().activate(budgetId);
 }
 
 bool ImagePool::addImage(const std::filesystem::path& filepath) {
-	paths.emplace_back(filepath);
+	return addImage(filepath, nullptr);
+}
+
+bool ImagePool::addImage(
+	const std::filesystem::path& name,
+	std::function<std::vector<uint8_t>()> reader, const wxSize& size) {
+	joinBudget();
+	std::lock_guard<std::mutex> guard(sourceLock);
+	paths.emplace_back(name);
+	readers.emplace_back(std::move(reader));
 	bitmaps.emplace_back();
+	tileSources.emplace_back();
+	tiles.emplace_back();
+	levels.emplace_back(0);
+	sizes.emplace_back(
+		size.GetWidth() > 0 && size.GetHeight() > 0 ? size : wxDefaultSize);
 	return true;
 }
 
+void ImagePool::setReader(
+	int index, std::function<std::vector<uint8_t>()> reader) {
+	std::lock_guard<std::mutex> guard(sourceLock);
+	readers[index] = std::move(reader);
+}
+
+unsigned long long imageBytes(const wxImage& image) {
+	const auto pixels =
+		static_cast<unsigned long long>(image.GetWidth()) * image.GetHeight();
+	return pixels * (image.HasAlpha() ? 4 : 3);
+}
+
+unsigned long long bitmapBytes(const wxBitmap& bitmap) {
+	const auto pixels =
+		static_cast<unsigned long long>(bitmap.GetWidth()) * bitmap.GetHeight();
+#ifdef __WXGTK__
+	// Cairo and GdkPixbuf pad every pixel to 32 bits whatever the depth
+	return pixels * 4;
+#else
+	return pixels * ((bitmap.GetDepth() + 7) / 8);
+#endif
+}
+
+DecodedImage decodeImage(
+	const std::function<std::vector<uint8_t>()>& reader,
+	const std::filesystem::path& path, int level) {
+	if (reader) { return decodeImage(reader(), path, level); }
+	try {
+		const MappedFile mapping(path);
+		return decodeImage(mapping.data(), mapping.size(), path, level);
+	} catch (const std::filesystem::filesystem_error&) {
+		return DecodedImage();
+	}
+}
+
+// Large images are moved into a tile source right away. They are still
+// decoded whole first, so the peak while decoding one is the full image:
+// neither the codecs nor wxImage decode a band of rows at a time. What
+// tiling saves is every moment after that.
+ImagePool::Prepared ImagePool::prepare(DecodedImage decoded) const {
+	Prepared prepared;
+	if (decoded.image.IsOk() && needsTiles(decoded.image.GetSize())) {
+		prepared.tiles = std::make_shared<TileSource>(decoded.image);
+		decoded.image = wxImage();
+	}
+	prepared.decoded = std::move(decoded);
+	return prepared;
+}
+
+void ImagePool::adopt(int index, Prepared prepared) {
+	dropTiles(index);
+	if (prepared.tiles) {
+		bitmaps[index].UnRef();
+		tiles[index].resize(prepared.tiles->count());
+		tileSources[index] = std::move(prepared.tiles);
+	} else {
+		bitmaps[index] = wxBitmap(prepared.decoded.image);
+	}
+	levels[index] = prepared.decoded.level;
+	sizes[index] = prepared.decoded.size;
+}
+
+bool ImagePool::loaded(int index) const {
+	return bitmaps[index].IsOk() || tileSources[index];
+}
+
 void ImagePool::load(int index) {
-	if (!bitmaps[index].IsOk()) { bitmaps[index] = ::load(paths[index]); }
-	const auto& s = bitmaps[index].GetSize();
-	// Approx mem of an image
-	const auto size = s.GetHeight() * s.GetWidth() * 3 * sizeof(unsigned char);
-	lru.hit(index, size);
+	TraceSpan span("ImagePool::load");
+	std::optional<Prepared> prepared;
+	{
+		std::lock_guard<std::mutex> guard(sourceLock);
+		auto it = prefetched.find(index);
+		if (it != prefetched.end() &&
+			(!loaded(index) || it->second.decoded.level < levels[index])) {
+			prepared = std::move(it->second);
+			prefetched.erase(it);
+		}
+	}
+	if (prepared) { adopt(index, std::move(*prepared)); }
+	// Decoding is left to the prefetcher, see request()
+	if (!loaded(index)) { return; }
+	// Tiles are weighed on their own, the source only takes disk space
+	lru.hit(lruKey(index), tiled(index) ? 0 : bitmapBytes(bitmaps[index]));
+}
+
+// Runs on one of the prefetcher's threads, other indices may be decoding
+// next to it
+void ImagePool::prefetch(int index) {
+	std::function<std::vector<uint8_t>()> reader;
+	std::filesystem::path path;
+	bool decode = true;
+	int wanted = 0;
+	{
+		std::lock_guard<std::mutex> guard(sourceLock);
+		if (index >= static_cast<int>(paths.size())) { return; }
+		reader = readers[index];
+		path = paths[index];
+		wanted = level;
+		auto it = prefetched.find(index);
+		decode = it == prefetched.end() || it->second.decoded.level > wanted;
+	}
+	Prepared prepared;
+	if (decode) {
+		TraceSpan span("ImagePool::prefetch");
+		try {
+			prepared = prepare(decodeImage(reader, path, wanted));
+		} catch (const std::exception& e) {
+			// On a prefetch worker, the page stays a placeholder
+			wxLogTrace(
+				"decode", "Unable to decode %s: %s", path.string(), e.what());
+		}
+	}
+	auto& image = prepared.decoded.image;
+	const auto ok = image.IsOk() || prepared.tiles;
+
+	bool notify = false;
+	{
+		std::lock_guard<std::mutex> guard(sourceLock);
+		notify = requested.erase(index) > 0;
+		const auto bytes = imageBytes(image);
+		if (decode && !ok) {
+			// Remembered so paint doesn't keep asking for it
+			if (notify) { failed.insert(index); }
+		} else if (ok && (notify || bytes <= prefetchBudget)) {
+			// Requested images are stored even over budget, they are about
+			// to be shown and move to the LRU
+			prefetchBudget -= std::min(bytes, prefetchBudget);
+			prefetched[index] = prepared;
+		}
+		// wxImage isn't thread safe, drop this thread's reference under the
+		// lock
+		image.UnRef();
+	}
+	if (notify && owner) {
+		owner->QueueEvent(new wxCommandEvent(
+			wxEVT_COMMAND_TEXT_UPDATED, IMAGE_POOL_UPDATE_ID));
+	}
+}
+
+void ImagePool::startPrefetcher() {
+	if (!prefetcher) {
+		prefetcher = std::make_unique<Prefetcher>(
+			[this](int i) { prefetch(i); }, workers);
+	}
+}
+
+void ImagePool::prefetch(const std::vector<std::pair<int, int>>& indices) {
+	startPrefetcher();
+	prefetcher->cancel();
+
+	std::lock_guard<std::mutex> guard(sourceLock);
+	auto wanted = [&](int index) {
+		return requested.count(index) > 0 ||
+			   std::any_of(indices.begin(), indices.end(), [index](auto& e) {
+				   return e.first == index;
+			   });
+	};
+	for (auto it = prefetched.begin(); it != prefetched.end();) {
+		it = wanted(it->first) ? std::next(it) : prefetched.erase(it);
+	}
+	updatePrefetchBudget();
+
+	// Pending requests were cancelled along with everything else
+	for (const auto index : requested) {
+		prefetcher->schedule(index, REQUEST_PRIORITY);
+	}
+	for (const auto& [index, priority] : indices) {
+		if (index < 0 || index >= static_cast<int>(bitmaps.size())) {
+			continue;
+		}
+		if (sharp(index)) { continue; }
+		auto it = prefetched.find(index);
+		if (it == prefetched.end() || it->second.decoded.level > level) {
+			prefetcher->schedule(index, priority);
+		}
+	}
+}
+
+void ImagePool::updatePrefetchBudget() {
+	unsigned long long kept = 0;
+	for (const auto& [index, prepared] : prefetched) {
+		kept += imageBytes(prepared.decoded.image);
+	}
+	// Prefetched images stay out of the LRU until they are shown, so they
+	// can only use what is left of its budget and never evict anything
+	const auto used = lru.weight() + kept;
+	prefetchBudget = used < lru.capacity() ? lru.capacity() - used : 0;
+}
+
+void ImagePool::offer(int index, DecodedImage decoded) {
+	if (!decoded.image.IsOk() || index >= static_cast<int>(paths.size()) ||
+		sharp(index)) {
+		return;
+	}
+	// Loaded as if shown, the LRU weighs it against the budget and evicts
+	// it in turn instead of the next prefetch dropping it
+	adopt(index, prepare(std::move(decoded)));
+	lru.hit(lruKey(index), tiled(index) ? 0 : bitmapBytes(bitmaps[index]));
+	std::lock_guard<std::mutex> guard(sourceLock);
+	updatePrefetchBudget();
+}
+
+void ImagePool::cancelPrefetch() {
+	if (prefetcher) { prefetch({}); }
+}
+
+bool ImagePool::sharp(int index) const {
+	return loaded(index) && levels[index] <= level;
+}
+
+bool ImagePool::request(int index) {
+	bool upgrade = false;
+	{
+		std::lock_guard<std::mutex> guard(sourceLock);
+		const auto shown = loaded(index) ? levels[index] : MAX_DECODE_LEVEL + 1;
+		auto it = prefetched.find(index);
+		upgrade = it != prefetched.end() && it->second.decoded.level < shown;
+		const auto best = upgrade ? it->second.decoded.level : shown;
+		// A coarser bitmap is still shown while the sharper one decodes
+		if (best > level && failed.count(index) == 0 &&
+			requested.insert(index).second) {
+			startPrefetcher();
+			prefetcher->schedule(index, REQUEST_PRIORITY);
+		}
+	}
+	if (!upgrade && !loaded(index)) { return false; }
+	// Either shown already or decoded by the prefetcher, load() only has to
+	// make the bitmap
+	load(index);
+	return true;
+}
+
+void ImagePool::setScale(double scale) {
+	// Coarsest level that still has a pixel for every screen pixel
+	int wanted = 0;
+	while (wanted < MAX_DECODE_LEVEL && scale * (2 << wanted) <= 1.0) {
+		++wanted;
+	}
+	std::lock_guard<std::mutex> guard(sourceLock);
+	level = wanted;
+}
+
+std::vector<std::pair<wxRect2DDouble, wxBitmap>> ImagePool::tilesIn(
+	int index, const wxRect2DDouble& area) {
+	std::vector<std::pair<wxRect2DDouble, wxBitmap>> visible;
+	const auto source = tileSources[index];
+	if (!source) { return visible; }
+	const auto& decoded = source->imageSize();
+	const auto sx = double(sizes[index].GetWidth()) / decoded.GetWidth();
+	const auto sy = double(sizes[index].GetHeight()) / decoded.GetHeight();
+
+	std::vector<int> shown;
+	for (int t = 0; t < source->count(); ++t) {
+		const auto r = source->rect(t);
+		const wxRect2DDouble rect(
+			r.GetLeft() * sx, r.GetTop() * sy, r.GetWidth() * sx,
+			r.GetHeight() * sy);
+		if (!rect.Intersects(area)) { continue; }
+		if (!tiles[index][t].IsOk()) {
+			tiles[index][t] = wxBitmap(source->read(t));
+		}
+		visible.emplace_back(rect, tiles[index][t]);
+		shown.push_back(t);
+	}
+	// Only after every tile is copied out, evictions may drop this image's
+	// tiles or the source itself
+	for (auto i = 0u; i < shown.size(); ++i) {
+		lru.hit(lruKey(index, shown[i]), bitmapBytes(visible[i].second));
+	}
+	return visible;
+}
+
+void ImagePool::unloadTile(int index, int tile) {
+	if (tile < static_cast<int>(tiles[index].size())) {
+		tiles[index][tile].UnRef();
+	}
+}
+
+void ImagePool::dropTiles(int index) {
+	for (int t = 0; t < static_cast<int>(tiles[index].size()); ++t) {
+		if (tiles[index][t].IsOk()) { lru.remove(lruKey(index, t)); }
+	}
+	tiles[index].clear();
+	tileSources[index].reset();
 }
 
 void ImagePool::unload(int index) {
+	dropTiles(index);
 	if (!bitmaps[index].IsOk()) return;
 	bitmaps[index].UnRef();
 }
 
 const wxSize ImagePool::size(int index) {
-	load(index);
-	return bitmap(index).GetSize();
+	if (sizes[index] == wxDefaultSize) { request(index); }
+	return sizes[index];
 }
 
 const wxBitmap& ImagePool::bitmap(int index) {
-	load(index);
+	if (!request(index)) { return wxNullBitmap; }
 	return bitmaps[index];
 }
 
 void ImagePool::clear() {
+	// Waits for an in flight prefetch
+	prefetcher.reset();
 	int size = static_cast<int>(bitmaps.size());
 	for (int i = 0; i < size; i++) { unload(i); }
+	lru.clear();
+	// An emptied pool gives its share back until images are added again
+	leaveBudget();
+	std::lock_guard<std::mutex> guard(sourceLock);
+	prefetched.clear();
+	requested.clear();
+	failed.clear();
 	paths.clear();
+	readers.clear();
 	bitmaps.clear();
+	tileSources.clear();
+	tiles.clear();
+	levels.clear();
+	sizes.clear();
 }
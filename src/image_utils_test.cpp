@@ -0,0 +1,202 @@
+#include "image_utils.hpp"
+
+#include <benchmark/benchmark.h>
+#include <gtest/gtest.h>
+#include <webp/decode.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "archive.hpp"
+#include "fixtures.hpp"
+
+std::vector<uint8_t> readTestImage() {
+	wxInitAllImageHandlers();
+	std::vector<uint8_t> content;
+	ArchiveReader("testdata/test.zip")
+		.read("test.png", [&content](const ArchiveFile& file) {
+			content = file.readContent();
+		});
+	return content;
+}
+
+TEST(imageUtils, DecodeReduced) {
+	const auto content = readTestImage();
+
+	const auto full = decodeImage(content, "test.png");
+	ASSERT_TRUE(full.image.IsOk());
+	EXPECT_EQ(full.size, wxSize(953, 272));
+	EXPECT_EQ(full.image.GetSize(), full.size);
+
+	const auto half = decodeImage(content, "test.png", 1);
+	EXPECT_EQ(half.level, 1);
+	EXPECT_EQ(half.size, full.size);
+	EXPECT_EQ(half.image.GetSize(), wxSize(476, 136));
+
+	const auto smallest = decodeImage(content, "test.png", 10);
+	EXPECT_EQ(smallest.level, MAX_DECODE_LEVEL);
+	EXPECT_EQ(smallest.image.GetSize(), wxSize(119, 34));
+}
+
+TEST(imageUtils, ThumbnailFormat) {
+	EXPECT_EQ(thumbnailFormat(nullptr).codec, ThumbnailCodec::WebP);
+	EXPECT_EQ(thumbnailFormat("raw").codec, ThumbnailCodec::Raw);
+	EXPECT_EQ(thumbnailFormat("original").codec, ThumbnailCodec::Original);
+	const auto webp = thumbnailFormat("webp:60:4");
+	EXPECT_EQ(webp.codec, ThumbnailCodec::WebP);
+	EXPECT_EQ(webp.quality, 60);
+	EXPECT_EQ(webp.method, 4);
+	EXPECT_EQ(thumbnailFormat("webp:abc").quality, ThumbnailFormat().quality);
+}
+
+TEST(imageUtils, ThumbnailCodecs) {
+	const auto content = readTestImage();
+	for (const auto codec : {
+			 ThumbnailCodec::Original, ThumbnailCodec::WebP,
+			 ThumbnailCodec::Raw}) {
+		ThumbnailFormat format;
+		format.codec = codec;
+		const auto thumbnail = makeThumbnail(content, "test.png", 400, format);
+		EXPECT_EQ(thumbnail.width, 400);
+		EXPECT_EQ(thumbnail.height, 114);
+		const auto decoded = decodeImage(
+			thumbnail.content, "cover" + thumbnail.extension);
+		ASSERT_TRUE(decoded.image.IsOk()) << thumbnail.extension;
+		EXPECT_EQ(decoded.size, wxSize(400, 114));
+	}
+}
+
+void BM_MakeThumbnail(benchmark::State& state) {
+	const auto content = readTestImage();
+	ThumbnailFormat format;
+	format.codec = static_cast<ThumbnailCodec>(state.range(0));
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(
+			makeThumbnail(content, "test.png", 400, format));
+	}
+}
+BENCHMARK(BM_MakeThumbnail)
+	->ArgName("codec")
+	->Arg(int(ThumbnailCodec::Original))
+	->Arg(int(ThumbnailCodec::WebP))
+	->Arg(int(ThumbnailCodec::Raw));
+
+// A large WebP page written once to the temp directory
+const std::filesystem::path& largeWebPPage() {
+	static const auto file =
+		fixturePage(PageFormat::WebP, wxSize(1988, 3056));
+	return file;
+}
+
+TEST(imageUtils, LoadWebPFile) {
+	const auto image = loadImage(largeWebPPage());
+	ASSERT_TRUE(image.IsOk());
+	EXPECT_EQ(image.GetSize(), wxSize(1988, 3056));
+	EXPECT_FALSE(loadImage("missing.webp").IsOk());
+}
+
+// How WebP files used to be loaded, read byte by byte and copied twice
+wxImage loadCopying(const std::filesystem::path& file) {
+	std::basic_ifstream<uint8_t, std::char_traits<uint8_t>> input(
+		file, std::ios::binary);
+	std::vector<uint8_t> bytes(
+		(std::istreambuf_iterator<uint8_t>(input)),
+		std::istreambuf_iterator<uint8_t>());
+	int iw = 0, ih = 0;
+	auto pixels = WebPDecodeRGB(bytes.data(), bytes.size(), &iw, &ih);
+	if (pixels == nullptr) { return wxImage(); }
+	wxImage img(iw, ih);
+	std::memcpy(img.GetData(), pixels, size_t(iw) * ih * 3);
+	WebPFree(pixels);
+	return img;
+}
+
+void BM_LoadWebPCopying(benchmark::State& state) {
+	const auto& file = largeWebPPage();
+	for (auto _ : state) { benchmark::DoNotOptimize(loadCopying(file)); }
+}
+BENCHMARK(BM_LoadWebPCopying)->Unit(benchmark::kMillisecond);
+
+void BM_LoadWebP(benchmark::State& state) {
+	const auto& file = largeWebPPage();
+	for (auto _ : state) { benchmark::DoNotOptimize(loadImage(file)); }
+}
+BENCHMARK(BM_LoadWebP)->Unit(benchmark::kMillisecond);
+
+// Args are the page format and width, pages are 3:2 portrait
+wxSize fixtureSize(const benchmark::State& state) {
+	return wxSize(state.range(1), state.range(1) * 3 / 2);
+}
+
+void BM_LoadImage(benchmark::State& state) {
+	const auto file =
+		fixturePage(PageFormat(state.range(0)), fixtureSize(state));
+	for (auto _ : state) { benchmark::DoNotOptimize(loadImage(file)); }
+	state.SetBytesProcessed(
+		state.iterations() * std::filesystem::file_size(file));
+}
+BENCHMARK(BM_LoadImage)
+	->ArgNames({"format", "width"})
+	->ArgsProduct({{0, 1, 2}, {800, 1988}})
+	->Unit(benchmark::kMillisecond);
+
+void BM_SaveThumbnail(benchmark::State& state) {
+	const auto file =
+		fixturePage(PageFormat(state.range(0)), fixtureSize(state));
+	const auto dest = std::filesystem::temp_directory_path() /
+					  ("comic_reader_thumb" + file.extension().string());
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(saveThumbnail(file, dest, 400));
+	}
+	std::filesystem::remove(dest);
+}
+BENCHMARK(BM_SaveThumbnail)
+	->ArgNames({"format", "width"})
+	->ArgsProduct({{0, 1, 2}, {800, 1988}})
+	->Unit(benchmark::kMillisecond);
+
+// Decodes run on the pool's workers, spin until the image is ready
+void waitUntilReady(ImagePool& pool, int index) {
+	while (!pool.request(index)) { std::this_thread::yield(); }
+}
+
+// Bitmap already in the pool
+void BM_ImagePoolHit(benchmark::State& state) {
+	if (!startWx()) {
+		state.SkipWithError("No display for bitmaps");
+		return;
+	}
+	ImagePool pool;
+	pool.addImage(fixturePage(PageFormat::Jpeg, wxSize(1200, 1800)));
+	waitUntilReady(pool, 0);
+	for (auto _ : state) { benchmark::DoNotOptimize(pool.bitmap(0).IsOk()); }
+}
+BENCHMARK(BM_ImagePoolHit);
+
+// Bitmap requested and decoded in the background, as for a page that was
+// never prefetched
+void BM_ImagePoolMiss(benchmark::State& state) {
+	if (!startWx()) {
+		state.SkipWithError("No display for bitmaps");
+		return;
+	}
+	const auto file =
+		fixturePage(PageFormat(state.range(0)), wxSize(1200, 1800));
+	ImagePool pool;
+	for (auto _ : state) {
+		state.PauseTiming();
+		pool.clear();
+		pool.addImage(file);
+		state.ResumeTiming();
+		waitUntilReady(pool, 0);
+		benchmark::DoNotOptimize(pool.bitmap(0).IsOk());
+	}
+}
+BENCHMARK(BM_ImagePoolMiss)
+	->ArgName("format")
+	->Arg(int(PageFormat::Jpeg))
+	->Arg(int(PageFormat::Png))
+	->Arg(int(PageFormat::WebP))
+	->Unit(benchmark::kMillisecond);
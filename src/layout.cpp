@@ -0,0 +1,154 @@
+#include "layout.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "fuzzy.hpp"
+
+namespace layout {
+	// Cover heights relative to the area, for the focused cover and the rest
+	const double FOCUSED_COVER = 0.9, REST_COVER = 0.7;
+	// Space between covers, relative to the area height
+	const double COVER_GAP = 0.1;
+
+	template <typename T, typename U> T mix(T x, T y, U a) {
+		return x * (1 - a) + a * y;
+	}
+
+	Rect Rect::scaledAt(const Point& point, double scale) const {
+		return {
+			(x - point.x) * scale + point.x, (y - point.y) * scale + point.y,
+			width * scale, height * scale};
+	}
+
+	void coverFlow(
+		const std::vector<double>& aspects, double position, const Size& area,
+		std::vector<Cover>& covers) {
+		covers.clear();
+		const int size = aspects.size();
+		if (size == 0) { return; }
+		position = std::clamp(position, 0.0, size - 1.0);
+		const auto idx = static_cast<int>(std::floor(position));
+		const auto nextIdx = static_cast<int>(std::ceil(position));
+		const auto frac = position - idx;
+
+		const auto gap = COVER_GAP * area.height;
+		const auto centre = 0.5 * area.height;
+		auto coverHeight = [&](int i) {
+			return area.height * (i == nextIdx
+									  ? mix(REST_COVER, FOCUSED_COVER, frac)
+									  : REST_COVER);
+		};
+		// Covers are placed by their centre, then turned into rects
+		auto cover = [&](int i, double x, double width, double height) {
+			return Cover{
+				i, {x - width / 2, centre - height / 2, width, height}};
+		};
+
+		auto focusHeight =
+			std::min(area.height, area.width / aspects[idx]) *
+			mix(FOCUSED_COVER, REST_COVER, frac);
+		const auto focusWidth = focusHeight * aspects[idx];
+		auto focusX = 0.5 * area.width;
+		if (nextIdx != idx) {
+			// Slide everything towards the next cover
+			const auto nextWidth = coverHeight(nextIdx) * aspects[nextIdx];
+			focusX -= frac * (0.5 * (focusWidth + nextWidth) + gap);
+		}
+
+		// Only the covers around idx that reach the screen are laid out
+		for (const int sgn : {1, -1}) {
+			auto lastX = focusX, lastWidth = focusWidth;
+			for (int i = idx + sgn; i >= 0 && i < size; i += sgn) {
+				const auto height = coverHeight(i);
+				const auto width = height * aspects[i];
+				const auto x = lastX + sgn * (0.5 * (lastWidth + width) + gap);
+				if ((sgn > 0 && x - width / 2 > area.width) ||
+					(sgn < 0 && x + width / 2 < 0)) {
+					break;
+				}
+				covers.push_back(cover(i, x, width, height));
+				lastX = x;
+				lastWidth = width;
+			}
+		}
+		covers.push_back(cover(idx, focusX, focusWidth, focusHeight));
+	}
+
+	double nextZoom(double zoom, const Size& client, const Size& page) {
+		std::vector<double> zooms = {
+			client.width / page.width, client.height / page.height, 1.0};
+		std::sort(zooms.begin(), zooms.end());
+		for (auto z : zooms) {
+			if (zoom < z && std::fabs(zoom - z) > 0.001) { return z; }
+		}
+		return zooms[0];
+	}
+
+	Rect fitViewport(const Rect& viewport, const Size& page) {
+		auto fitted = viewport;
+		// If there is extra space in both directions, scale viewport down to
+		// closest edge
+		if (viewport.width > page.width && viewport.height > page.height) {
+			fitted = fitted.scaledAt(
+				fitted.centre(), std::max(
+									 page.width / viewport.width,
+									 page.height / viewport.height));
+		}
+
+		if (viewport.width > page.width) {
+			fitted.x = (page.width - fitted.width) / 2;
+		} else if (fitted.x < 0) {
+			fitted.x = 0;
+		} else if (fitted.right() > page.width) {
+			fitted.x = page.width - fitted.width;
+		}
+
+		if (viewport.height > page.height) {
+			fitted.y = (page.height - fitted.height) / 2;
+		} else if (fitted.y < 0) {
+			fitted.y = 0;
+		} else if (fitted.bottom() > page.height) {
+			fitted.y = page.height - fitted.height;
+		}
+		return fitted;
+	}
+
+	Move nextView(const Rect& viewport, const Size& page) {
+		if (fuzzy::greater_equal(viewport.right(), page.width) &&
+			fuzzy::greater_equal(viewport.bottom(), page.height)) {
+			return {1, {}};
+		}
+		if (fuzzy::less(viewport.right(), page.width)) {
+			return {
+				0,
+				{std::min(viewport.width / 2, page.width - viewport.right()),
+				 0}};
+		}
+		return {
+			0,
+			{-std::max(0.0, page.width - viewport.width),
+			 std::min(viewport.height / 2, page.height - viewport.bottom())}};
+	}
+
+	Move previousView(const Rect& viewport, const Size& page) {
+		if (fuzzy::less_equal(viewport.x, 0) &&
+			fuzzy::less_equal(viewport.y, 0)) {
+			return {-1, {}};
+		}
+		if (fuzzy::greater(viewport.x, 0)) {
+			return {0, {-std::min(viewport.width / 2, viewport.x), 0}};
+		}
+		return {
+			0,
+			{std::max(0.0, page.width - viewport.width),
+			 -std::min(viewport.height / 2, viewport.y)}};
+	}
+
+	Rect pageRect(const Rect& viewport, const Size& client, const Size& page) {
+		const auto zoom = client.width / viewport.width;
+		return {
+			-viewport.x * zoom, -viewport.y * zoom, page.width * zoom,
+			page.height * zoom};
+	}
+}  // namespace layout
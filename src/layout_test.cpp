@@ -0,0 +1,136 @@
+#include "layout.hpp"
+
+#include <benchmark/benchmark.h>
+#include <gtest/gtest.h>
+
+TEST(layout, CoverFlowCentresFocus) {
+	const std::vector<double> aspects(5, 0.5);
+	std::vector<layout::Cover> covers;
+	layout::coverFlow(aspects, 2, {1000, 600}, covers);
+	ASSERT_EQ(covers.size(), 5);
+
+	// Drawn last, so on top
+	const auto& focus = covers.back();
+	EXPECT_EQ(focus.index, 2);
+	EXPECT_DOUBLE_EQ(focus.rect.height, 540);
+	EXPECT_DOUBLE_EQ(focus.rect.width, 270);
+	EXPECT_DOUBLE_EQ(focus.rect.centre().x, 500);
+	EXPECT_DOUBLE_EQ(focus.rect.centre().y, 300);
+
+	for (const auto& [i, rect] : covers) {
+		if (i == 2) { continue; }
+		EXPECT_DOUBLE_EQ(rect.height, 420);
+		// Never overlapping the focused cover
+		EXPECT_TRUE(rect.right() < focus.rect.x || rect.x > focus.rect.right());
+	}
+}
+
+TEST(layout, CoverFlowOnlyLaysOutVisibleCovers) {
+	const std::vector<double> aspects(100000, 0.7);
+	std::vector<layout::Cover> covers;
+	layout::coverFlow(aspects, 50000, {1000, 600}, covers);
+	EXPECT_LT(covers.size(), 10);
+	for (const auto& [i, rect] : covers) {
+		EXPECT_LT(rect.x, 1000);
+		EXPECT_GT(rect.right(), 0);
+	}
+
+	layout::coverFlow({}, 0, {1000, 600}, covers);
+	EXPECT_TRUE(covers.empty());
+}
+
+TEST(layout, CoverFlowSlidesToNext) {
+	const std::vector<double> aspects(3, 0.5);
+	std::vector<layout::Cover> start, middle, end;
+	layout::coverFlow(aspects, 0, {1000, 600}, start);
+	layout::coverFlow(aspects, 0.5, {1000, 600}, middle);
+	layout::coverFlow(aspects, 1, {1000, 600}, end);
+
+	auto find = [](const std::vector<layout::Cover>& covers, int i) {
+		for (const auto& cover : covers) {
+			if (cover.index == i) { return cover.rect; }
+		}
+		return layout::Rect();
+	};
+	// Halfway both covers are between their rest and focused heights
+	EXPECT_DOUBLE_EQ(find(middle, 0).height, 480);
+	EXPECT_DOUBLE_EQ(find(middle, 1).height, 480);
+	EXPECT_LT(find(middle, 1).centre().x, find(start, 1).centre().x);
+	EXPECT_GT(find(middle, 1).centre().x, find(end, 1).centre().x);
+	EXPECT_DOUBLE_EQ(find(end, 1).centre().x, 500);
+}
+
+TEST(layout, NextZoomCycles) {
+	const layout::Size client{1000, 500}, page{2000, 2000};
+	// Fit to height, fit to width, native and back
+	EXPECT_DOUBLE_EQ(layout::nextZoom(0.1, client, page), 0.25);
+	EXPECT_DOUBLE_EQ(layout::nextZoom(0.25, client, page), 0.5);
+	EXPECT_DOUBLE_EQ(layout::nextZoom(0.5, client, page), 1);
+	EXPECT_DOUBLE_EQ(layout::nextZoom(1, client, page), 0.25);
+}
+
+TEST(layout, FitViewport) {
+	const layout::Size page{1000, 2000};
+	// Larger than the page both ways, shrunk to the closest edge and centred
+	auto fitted = layout::fitViewport({-500, 0, 4000, 4000}, page);
+	EXPECT_DOUBLE_EQ(fitted.width, 2000);
+	EXPECT_DOUBLE_EQ(fitted.height, 2000);
+	EXPECT_DOUBLE_EQ(fitted.x, -500);
+	EXPECT_DOUBLE_EQ(fitted.y, 0);
+
+	// Moved back over the page
+	fitted = layout::fitViewport({-100, 1900, 500, 500}, page);
+	EXPECT_DOUBLE_EQ(fitted.x, 0);
+	EXPECT_DOUBLE_EQ(fitted.y, 1500);
+	EXPECT_DOUBLE_EQ(fitted.width, 500);
+
+	// Centred across the narrow page
+	fitted = layout::fitViewport({300, 100, 1500, 500}, page);
+	EXPECT_DOUBLE_EQ(fitted.x, -250);
+	EXPECT_DOUBLE_EQ(fitted.y, 100);
+}
+
+TEST(layout, ViewsFollowReadingOrder) {
+	const layout::Size page{1000, 1000};
+	// Right along the row, then back to the left of the next one
+	auto move = layout::nextView({0, 0, 500, 500}, page);
+	EXPECT_EQ(move.page, 0);
+	EXPECT_DOUBLE_EQ(move.delta.x, 250);
+	EXPECT_DOUBLE_EQ(move.delta.y, 0);
+	move = layout::nextView({500, 0, 500, 500}, page);
+	EXPECT_DOUBLE_EQ(move.delta.x, -500);
+	EXPECT_DOUBLE_EQ(move.delta.y, 250);
+	EXPECT_EQ(layout::nextView({500, 500, 500, 500}, page).page, 1);
+
+	move = layout::previousView({0, 500, 500, 500}, page);
+	EXPECT_EQ(move.page, 0);
+	EXPECT_DOUBLE_EQ(move.delta.x, 500);
+	EXPECT_DOUBLE_EQ(move.delta.y, -250);
+	EXPECT_EQ(layout::previousView({0, 0, 500, 500}, page).page, -1);
+}
+
+TEST(layout, PageRect) {
+	const auto rect =
+		layout::pageRect({100, 50, 500, 250}, {1000, 500}, {800, 1200});
+	EXPECT_DOUBLE_EQ(rect.x, -200);
+	EXPECT_DOUBLE_EQ(rect.y, -100);
+	EXPECT_DOUBLE_EQ(rect.width, 1600);
+	EXPECT_DOUBLE_EQ(rect.height, 2400);
+}
+
+void BM_CoverFlow(benchmark::State& state) {
+	std::vector<double> aspects(state.range(0));
+	for (size_t i = 0; i < aspects.size(); ++i) {
+		aspects[i] = 0.5 + 0.1 * (i % 5);
+	}
+	std::vector<layout::Cover> covers;
+	double position = 0;
+	for (auto _ : state) {
+		// Sliding through the middle of the library, as while animating
+		position = position < 100 ? position + 0.01 : 0;
+		layout::coverFlow(
+			aspects, aspects.size() / 2 + position, {1920, 1080}, covers);
+		benchmark::DoNotOptimize(covers.data());
+	}
+}
+BENCHMARK(BM_CoverFlow)->Arg(100)->Arg(100000);
@@ -0,0 +1,334 @@
+#include "library.hpp"
+
+#include <wx/log.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+bool isComic(const std::filesystem::path& file) {
+	auto ext = file.extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) {
+		return static_cast<char>(std::tolower(c));
+	});
+	return ext == ".cbz" || ext == ".cbr";
+}
+
+std::vector<std::filesystem::path> findComics(
+	const std::vector<std::filesystem::path>& roots, unsigned int workers,
+	const std::function<void(const std::filesystem::path&)>& visit) {
+	std::mutex lock;
+	std::condition_variable wake;
+	std::vector<std::filesystem::path> pending(roots.begin(), roots.end());
+	std::vector<std::filesystem::path> found;
+	unsigned int busy = 0;
+
+	auto walk = [&]() {
+		std::unique_lock<std::mutex> guard(lock);
+		while (true) {
+			// Done once nothing is queued and nobody can queue more
+			wake.wait(guard, [&]() { return !pending.empty() || busy == 0; });
+			if (pending.empty()) { return; }
+			const auto dir = std::move(pending.back());
+			pending.pop_back();
+			++busy;
+			guard.unlock();
+
+			if (visit) { visit(dir); }
+			std::vector<std::filesystem::path> dirs, comics;
+			std::error_code error;
+			for (std::filesystem::directory_iterator it(dir, error), end;
+				 !error && it != end; it.increment(error)) {
+				std::error_code ignored;
+				// Linked directories are skipped, they can form cycles
+				if (it->is_directory(ignored) && !it->is_symlink(ignored)) {
+					dirs.push_back(it->path());
+				} else if (
+					isComic(it->path()) && it->is_regular_file(ignored)) {
+					comics.push_back(it->path());
+				}
+			}
+
+			guard.lock();
+			--busy;
+			found.insert(found.end(), comics.begin(), comics.end());
+			pending.insert(pending.end(), dirs.begin(), dirs.end());
+			wake.notify_all();
+		}
+	};
+
+	if (workers == 0) { workers = std::thread::hardware_concurrency(); }
+	workers = std::max(workers, 1u);
+	std::vector<std::thread> threads;
+	for (auto i = 1u; i < workers; ++i) { threads.emplace_back(walk); }
+	walk();
+	for (auto& thread : threads) { thread.join(); }
+	return found;
+}
+
+void LibraryChange::merge(const LibraryChange& later) {
+	for (const auto& path : later.removed) {
+		added.erase(path);
+		removed.insert(path);
+	}
+	for (const auto& path : later.added) {
+		removed.erase(path);
+		added.insert(path);
+	}
+}
+
+// Whether `path` is `dir` or somewhere below it
+bool isInside(
+	const std::filesystem::path& path, const std::filesystem::path& dir) {
+	return std::mismatch(dir.begin(), dir.end(), path.begin(), path.end())
+			   .first == dir.end();
+}
+
+Library::Library(const std::filesystem::path& rootsFile)
+	: rootsFile(rootsFile), stopping(false), notifier(-1) {
+	std::ifstream input(rootsFile);
+	for (std::string line; std::getline(input, line);) {
+		if (!line.empty()) { rootDirs.emplace_back(line); }
+	}
+}
+
+Library::~Library() { stopWatching(); }
+
+void Library::saveRoots() const {
+	const auto dirs = roots();
+	std::filesystem::create_directories(rootsFile.parent_path());
+	std::ofstream output(rootsFile, std::ios::trunc);
+	for (const auto& root : dirs) { output << root.string() << '\n'; }
+}
+
+std::vector<std::filesystem::path> Library::roots() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return rootDirs;
+}
+
+bool Library::addRoot(const std::filesystem::path& dir) {
+	const auto root = std::filesystem::weakly_canonical(dir);
+	if (!std::filesystem::is_directory(root)) { return false; }
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (std::find(rootDirs.begin(), rootDirs.end(), root) !=
+			rootDirs.end()) {
+			return false;
+		}
+		rootDirs.push_back(root);
+		pendingRoots.push_back(root);
+	}
+	saveRoots();
+	return true;
+}
+
+void Library::scan(unsigned int workers) {
+	std::vector<std::filesystem::path> dirs;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		dirs = rootDirs;
+		pendingRoots.clear();
+	}
+	auto found = findComics(
+		dirs, workers,
+		[this](const std::filesystem::path& dir) { addWatch(dir); });
+	const std::set<std::filesystem::path> current(found.begin(), found.end());
+	std::lock_guard<std::mutex> guard(lock);
+	std::vector<std::filesystem::path> gone;
+	std::set_difference(
+		archives.begin(), archives.end(), current.begin(), current.end(),
+		std::back_inserter(gone));
+	for (const auto& path : gone) { removeArchive(path); }
+	for (const auto& path : current) {
+		if (!archives.count(path)) { addArchive(path); }
+	}
+}
+
+void Library::addTree(const std::filesystem::path& dir) {
+	auto found = findComics(
+		{dir}, 1, [this](const std::filesystem::path& d) { addWatch(d); });
+	std::lock_guard<std::mutex> guard(lock);
+	for (const auto& path : found) {
+		if (!archives.count(path)) { addArchive(path); }
+	}
+}
+
+void Library::removeTree(const std::filesystem::path& dir) {
+	std::lock_guard<std::mutex> guard(lock);
+	// Everything below `dir` sorts right after it
+	auto it = archives.lower_bound(dir);
+	while (it != archives.end() && isInside(*it, dir)) {
+		// A copy, erasing the archive would leave a reference dangling
+		const auto path = *it++;
+		removeArchive(path);
+	}
+#ifdef __linux__
+	// Moved away directories keep their watches, which now have stale paths
+	for (auto w = watches.begin(); w != watches.end();) {
+		if (isInside(w->second, dir)) {
+			inotify_rm_watch(notifier, w->first);
+			w = watches.erase(w);
+		} else {
+			++w;
+		}
+	}
+#endif
+}
+
+void Library::addArchive(const std::filesystem::path& path) {
+	archives.insert(path);
+	pending.removed.erase(path);
+	pending.added.insert(path);
+}
+
+void Library::removeArchive(const std::filesystem::path& path) {
+	if (archives.erase(path) == 0) { return; }
+	pending.added.erase(path);
+	pending.removed.insert(path);
+}
+
+std::vector<std::filesystem::path> Library::comics() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return std::vector<std::filesystem::path>(archives.begin(), archives.end());
+}
+
+void Library::addWatch(const std::filesystem::path& dir) {
+#ifdef __linux__
+	if (notifier < 0) { return; }
+	const auto wd = inotify_add_watch(
+		notifier, dir.c_str(),
+		IN_CREATE | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+			IN_ONLYDIR);
+	if (wd < 0) {
+		// Directories are walked on the watcher thread
+		wxLogTrace("library", "Unable to watch %s", dir.string());
+		return;
+	}
+	std::lock_guard<std::mutex> guard(lock);
+	watches[wd] = dir;
+#endif
+}
+
+void Library::startWatching(
+	std::function<void(const LibraryChange&)> onChange) {
+	stopWatching();
+	changed = std::move(onChange);
+#ifdef __linux__
+	notifier = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (notifier < 0) { wxLogWarning("Unable to watch the library"); }
+#endif
+	stopping.store(false);
+	watcher = std::thread(&Library::watch, this);
+}
+
+void Library::stopWatching() {
+	stopping.store(true);
+	if (watcher.joinable()) { watcher.join(); }
+#ifdef __linux__
+	if (notifier >= 0) { close(notifier); }
+#endif
+	notifier = -1;
+	std::lock_guard<std::mutex> guard(lock);
+	watches.clear();
+}
+
+void Library::report() {
+	LibraryChange change;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		std::swap(change, pending);
+	}
+	if (!change.empty() && changed) { changed(change); }
+}
+
+void Library::watch() {
+	// Watches are added as the directories are walked
+	scan();
+	{
+		// Nothing was reported to `changed` yet
+		std::lock_guard<std::mutex> guard(lock);
+		pending = LibraryChange();
+		pending.added = archives;
+	}
+	report();
+	while (!stopping.load()) {
+		// Wakes up regularly to notice stopWatching() and new roots
+#ifdef __linux__
+		pollfd fd{notifier, POLLIN, 0};
+		if (notifier < 0) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(250));
+		} else if (poll(&fd, 1, 250) > 0) {
+			readEvents();
+		}
+#else
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+#endif
+		std::vector<std::filesystem::path> added;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			added.swap(pendingRoots);
+		}
+		for (const auto& root : added) { addTree(root); }
+		report();
+	}
+}
+
+void Library::readEvents() {
+#ifdef __linux__
+	alignas(inotify_event) char buffer[64 * 1024];
+	ssize_t length;
+	while ((length = read(notifier, buffer, sizeof(buffer))) > 0) {
+		for (auto pos = buffer; pos < buffer + length;) {
+			const auto* event = reinterpret_cast<const inotify_event*>(pos);
+			pos += sizeof(inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				// Events were lost, only a full scan can catch up
+				scan(1);
+				continue;
+			}
+			std::filesystem::path dir;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				auto it = watches.find(event->wd);
+				if (it == watches.end()) { continue; }
+				if (event->mask & IN_IGNORED) {
+					watches.erase(it);
+					continue;
+				}
+				dir = it->second;
+			}
+			if (event->len == 0) { continue; }
+			const auto path = dir / event->name;
+
+			if (event->mask & IN_ISDIR) {
+				if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+					addTree(path);
+				} else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+					removeTree(path);
+				}
+			} else if (isComic(path)) {
+				// New files are picked up once fully written, rewritten ones
+				// count as changed
+				if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+					std::lock_guard<std::mutex> guard(lock);
+					addArchive(path);
+				} else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+					std::lock_guard<std::mutex> guard(lock);
+					removeArchive(path);
+				}
+			}
+		}
+	}
+#endif
+}
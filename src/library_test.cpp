@@ -0,0 +1,128 @@
+#include "library.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "fixtures.hpp"
+
+class LibraryTest : public ::testing::Test {
+   protected:
+	std::filesystem::path tempDir;
+	std::filesystem::path root;
+
+	void SetUp() override {
+		tempDir = uniqueTempDirectory("comic_reader_library");
+		root = tempDir / "comics";
+		std::filesystem::create_directories(root / "a" / "b");
+		std::filesystem::create_directories(root / "c");
+		std::ofstream(root / "one.cbz") << "archive";
+		std::ofstream(root / "a" / "b" / "two.CBR") << "archive";
+		std::ofstream(root / "c" / "notes.txt") << "text";
+	}
+
+	void TearDown() override { std::filesystem::remove_all(tempDir); }
+};
+
+TEST_F(LibraryTest, FindsNestedComics) {
+	for (const auto workers : {1u, 4u}) {
+		EXPECT_THAT(
+			findComics({root}, workers),
+			::testing::UnorderedElementsAre(
+				root / "one.cbz", root / "a" / "b" / "two.CBR"));
+	}
+	EXPECT_THAT(findComics({tempDir / "missing"}), ::testing::IsEmpty());
+}
+
+TEST_F(LibraryTest, RemembersRoots) {
+	const auto rootsFile = tempDir / "data" / "library.txt";
+	{
+		Library library(rootsFile);
+		EXPECT_TRUE(library.addRoot(root));
+		EXPECT_FALSE(library.addRoot(root));
+		EXPECT_FALSE(library.addRoot(tempDir / "missing"));
+		// Not watching, so nothing walks the new root until a scan
+		EXPECT_TRUE(library.comics().empty());
+		library.scan();
+		EXPECT_EQ(library.comics().size(), 2);
+	}
+	Library library(rootsFile);
+	ASSERT_EQ(library.roots().size(), 1);
+	EXPECT_TRUE(library.comics().empty());
+	library.scan();
+	EXPECT_EQ(library.comics().size(), 2);
+}
+
+#ifdef __linux__
+TEST_F(LibraryTest, FollowsChanges) {
+	Library library(tempDir / "library.txt");
+	library.addRoot(root);
+	std::mutex lock;
+	LibraryChange reported;
+	library.startWatching([&](const LibraryChange& change) {
+		std::lock_guard<std::mutex> guard(lock);
+		reported.merge(change);
+	});
+	// Waits for a report, then takes everything reported since last time
+	auto take = [&]() {
+		for (int i = 0; i < 100; ++i) {
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if (!reported.empty()) {
+					return std::exchange(reported, LibraryChange());
+				}
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}
+		return LibraryChange();
+	};
+
+	auto waitFor = [&](size_t count) {
+		for (int i = 0; i < 100 && library.comics().size() != count; ++i) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}
+		return library.comics().size();
+	};
+
+	// The first scan runs on the watcher and reports every comic
+	auto change = take();
+	EXPECT_EQ(library.comics().size(), 2);
+	EXPECT_THAT(
+		change.added,
+		::testing::ElementsAre(root / "a" / "b" / "two.CBR", root / "one.cbz"));
+
+	// Only what changed is reported, not the comics known already
+	std::filesystem::create_directories(root / "new");
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	std::ofstream(root / "new" / "three.cbz") << "archive";
+	EXPECT_EQ(waitFor(3), 3);
+	change = take();
+	EXPECT_THAT(
+		change.added, ::testing::ElementsAre(root / "new" / "three.cbz"));
+	EXPECT_TRUE(change.removed.empty());
+
+	std::filesystem::remove_all(root / "a");
+	EXPECT_EQ(waitFor(2), 2);
+	EXPECT_THAT(
+		library.comics(),
+		::testing::UnorderedElementsAre(
+			root / "one.cbz", root / "new" / "three.cbz"));
+	change = take();
+	EXPECT_TRUE(change.added.empty());
+	EXPECT_THAT(
+		change.removed, ::testing::ElementsAre(root / "a" / "b" / "two.CBR"));
+
+	const auto more = tempDir / "more";
+	std::filesystem::create_directories(more);
+	std::ofstream(more / "four.cbz") << "archive";
+	EXPECT_TRUE(library.addRoot(more));
+	EXPECT_EQ(waitFor(3), 3);
+	EXPECT_THAT(take().added, ::testing::ElementsAre(more / "four.cbz"));
+	library.stopWatching();
+}
+#endif
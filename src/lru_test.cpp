@@ -4,7 +4,10 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <functional>
+#include <list>
 #include <random>
+#include <unordered_map>
 
 TEST(lru, simple) {
 	LRU<int, int> lru(5, 5);
@@ -27,12 +30,109 @@ TEST(lru, simple) {
 	EXPECT_THAT(evicted, ::testing::ElementsAre(2));
 }
 
-void BM_LRU(benchmark::State& state) {
-	std::random_device rd;
+TEST(lru, weighted) {
+	LRU<int, int> lru(10, 1);
+	std::vector<int> evicted;
+	lru.addEvictionHook([&evicted](int k) { evicted.emplace_back(k); });
+
+	lru.hit(1, 4);
+	lru.hit(2, 4);
+	lru.hit(1, 2);
+	EXPECT_EQ(lru.weight(), 6);
+	lru.hit(3, 5);
+	EXPECT_THAT(evicted, ::testing::ElementsAre(2));
+	EXPECT_EQ(lru.weight(), 7);
+	// The last entry is kept even when it alone is over capacity
+	lru.hit(4, 20);
+	EXPECT_THAT(evicted, ::testing::ElementsAre(2, 1, 3));
+	EXPECT_EQ(lru.weight(), 20);
+}
+
+TEST(lru, remove) {
+	LRU<int, int> lru(3, 1);
+	std::vector<int> evicted;
+	lru.addEvictionHook([&evicted](int k) { evicted.emplace_back(k); });
+
+	lru.hit(1);
+	lru.hit(2);
+	lru.hit(3);
+	lru.remove(2);
+	lru.remove(7);
+	EXPECT_EQ(lru.weight(), 2);
+	lru.hit(4);
+	lru.hit(5);
+	EXPECT_THAT(evicted, ::testing::ElementsAre(1));
+}
+
+// The list and hash map LRU this one replaced, kept as the reference for
+// eviction order and speed
+template <typename K, typename W> class ListLRU {
+	std::list<std::pair<K, W>> hits;
+	std::unordered_map<K, typename std::list<std::pair<K, W>>::iterator>
+		positions;
+	W currentWeight;
+	W maxWeight;
+	unsigned int minCount;
+	std::function<void(K)> evictionHook;
+
+   public:
+	ListLRU(W maxW, unsigned int minC)
+		: currentWeight(0), maxWeight(maxW), minCount(minC) {}
+
+	W weight() const { return currentWeight; }
+
+	void addEvictionHook(std::function<void(K)> func) { evictionHook = func; }
+
+	void hit(K key, W weight = 1) {
+		auto it = positions.find(key);
+		if (it != positions.end()) {
+			currentWeight -= it->second->second;
+			hits.erase(it->second);
+		}
+		currentWeight += weight;
+		hits.emplace_back(key, weight);
+		positions[key] = std::prev(std::end(hits));
+		while (hits.size() > minCount && currentWeight > maxWeight) {
+			auto del = hits.front();
+			hits.pop_front();
+			positions.erase(del.first);
+			if (evictionHook) { evictionHook(del.first); }
+			currentWeight -= del.second;
+		}
+	}
+};
+
+TEST(lru, matchesListImplementation) {
+	const int cap = 100;
+	LRU<int, int> lru(cap, 3);
+	ListLRU<int, int> reference(cap, 3);
+	std::vector<int> evicted, expected;
+	lru.addEvictionHook([&evicted](int k) { evicted.emplace_back(k); });
+	reference.addEvictionHook([&expected](int k) { expected.emplace_back(k); });
+
+	std::mt19937 gen(42);
+	std::uniform_int_distribution<int> keys(0, 300), weights(1, 10);
+	for (int n = 0; n < 100000; ++n) {
+		const auto key = keys(gen), w = weights(gen);
+		lru.hit(key, w);
+		reference.hit(key, w);
+		ASSERT_EQ(lru.weight(), reference.weight());
+	}
+	EXPECT_EQ(evicted, expected);
+}
+
+// Args are the capacity and how many times more keys than fit are drawn.
+// Both caches see the same keys from the same generator.
+template <typename Cache> void BM_LRU(benchmark::State& state) {
+	std::mt19937 gen(42);
 	const auto cap = int(state.range(0) / 4);
-	std::uniform_int_distribution<int> dist(0, cap);
-	LRU<int, int> lru(cap, (unsigned int)cap);
-	for (auto _ : state) { lru.hit(dist(rd)); }
-	state.SetComplexityN(state.range(0));
+	std::uniform_int_distribution<int> dist(0, cap * state.range(1));
+	Cache lru(cap, (unsigned int)cap);
+	for (auto _ : state) { lru.hit(dist(gen)); }
 }
-BENCHMARK(BM_LRU)->RangeMultiplier(2)->Range(1 << 10, 1 << 18)->Complexity();
+BENCHMARK(BM_LRU<LRU<int, int>>)
+	->ArgNames({"size", "keys"})
+	->ArgsProduct({{1 << 10, 1 << 14, 1 << 18}, {1, 4}});
+BENCHMARK(BM_LRU<ListLRU<int, int>>)
+	->ArgNames({"size", "keys"})
+	->ArgsProduct({{1 << 10, 1 << 14, 1 << 18}, {1, 4}});
@@ -1,15 +1,22 @@
 #include <wx/app.h>
+#include <wx/dirdlg.h>
 #include <wx/frame.h>
+#include <wx/log.h>
 #include <wx/msgdlg.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <cstdlib>
 #include <filesystem>
+#include <mutex>
 #include <vector>
 
 #include "comic.hpp"
 #include "comic_gallery.hpp"
 #include "comic_viewer.hpp"
+#include "library.hpp"
+#include "trace.hpp"
 #include "util.hpp"
 
 class MyApp : public wxApp {
@@ -25,8 +32,17 @@ class MyFrame : public wxFrame {
 	ComicViewer* comicViewer = nullptr;
 	wxSizer* sizer = nullptr;
 	int lastKeyCode = 0;
+	Library library;
+	// Gathered from the library watcher, applied once no comic is open
+	std::mutex libraryLock;
+	LibraryChange libraryChange;
+	std::atomic_bool libraryChanged;
 
 	void OnKeyDown(wxKeyEvent& event);
+	void OnLibraryChange();
+	void AddLibraryFolder();
+	void WatchLibrary();
+	void ToggleTrace();
 
    public:
 	MyFrame();
@@ -35,13 +51,22 @@ class MyFrame : public wxFrame {
 
 const auto DEFAULT_FRAME_TITLE = "Select Comic";
 
+// Set COMIC_READER_TRACE to trace from startup into that file
+std::filesystem::path traceFile() {
+	const auto file = std::getenv("COMIC_READER_TRACE");
+	if (file != nullptr && *file != '\0') { return file; }
+	return getDataDirectory() / "trace.json";
+}
+
 int MyApp::OnExit() {
+	if (Trace::enabled()) { Trace::stop(traceFile()); }
 	std::filesystem::remove_all(cacheDirectory);
 	return 0;
 }
 
 bool MyApp::OnInit() {
 	::wxInitAllImageHandlers();
+	if (std::getenv("COMIC_READER_TRACE") != nullptr) { Trace::start(); }
 
 	auto frame = new MyFrame();
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
@@ -53,11 +78,20 @@ bool MyApp::OnInit() {
 	return true;
 }
 
-MyFrame::MyFrame() : wxFrame(nullptr, wxID_ANY, "") {
+MyFrame::MyFrame()
+	: wxFrame(nullptr, wxID_ANY, ""),
+	  library(getDataDirectory() / "library.txt"),
+	  libraryChanged(false) {
 	Bind(wxEVT_CHAR_HOOK, &MyFrame::OnKeyDown, this);
 }
 
 void MyFrame::OnKeyDown(wxKeyEvent& event) {
+	Trace::input();
+	if (event.GetKeyCode() == 'T' &&
+		(event.CmdDown() || event.ControlDown())) {
+		ToggleTrace();
+		return;
+	}
 	if (comicViewer != nullptr) {
 		switch (event.GetKeyCode()) {
 			case WXK_LEFT:
@@ -74,6 +108,7 @@ void MyFrame::OnKeyDown(wxKeyEvent& event) {
 				comicGallery->currentComic().unload();
 				Layout();
 				SetTitle(DEFAULT_FRAME_TITLE);
+				if (libraryChanged.load()) { OnLibraryChange(); }
 				break;
 			case 'Z':
 				comicViewer->NextZoom(event.GetPosition());
@@ -94,6 +129,7 @@ void MyFrame::OnKeyDown(wxKeyEvent& event) {
 				comicGallery->HandleInput(Navigation::NextComic);
 				break;
 			case WXK_RETURN:
+				if (comicGallery->length() == 0) { break; }
 				try {
 					comicGallery->currentComic().unload();
 					comicViewer =
@@ -112,6 +148,14 @@ void MyFrame::OnKeyDown(wxKeyEvent& event) {
 				comicViewer->SetFocusFromKbd();
 				Layout();
 				break;
+			case 'L':
+				if (event.CmdDown() || event.ControlDown()) {
+					AddLibraryFolder();
+					break;
+				}
+				comicGallery->HandleInput(
+					Navigation::JumpToComic, event.GetKeyCode());
+				break;
 			default:
 				if (std::isalpha(std::clamp(event.GetKeyCode(), -1, 255))) {
 					comicGallery->HandleInput(
@@ -124,9 +168,71 @@ void MyFrame::OnKeyDown(wxKeyEvent& event) {
 	event.Skip();
 }
 
+void MyFrame::ToggleTrace() {
+	if (!Trace::enabled()) {
+		Trace::start();
+		wxLogStatus(this, "Tracing started");
+		return;
+	}
+	const auto file = traceFile();
+	std::error_code ignored;
+	if (file.has_parent_path()) {
+		std::filesystem::create_directories(file.parent_path(), ignored);
+	}
+	// The frame has no status bar to show where the trace went
+	if (Trace::stop(file)) {
+		wxLogMessage("Trace saved to %s", file.string());
+	} else {
+		wxLogError("Unable to save trace to %s", file.string());
+	}
+}
+
+void MyFrame::WatchLibrary() {
+	library.startWatching([this](const LibraryChange& change) {
+		// Runs on the watcher thread, bursts of changes are applied once
+		{
+			std::lock_guard<std::mutex> guard(libraryLock);
+			libraryChange.merge(change);
+		}
+		if (!libraryChanged.exchange(true)) {
+			CallAfter(&MyFrame::OnLibraryChange);
+		}
+	});
+}
+
+void MyFrame::OnLibraryChange() {
+	// The open comic is owned by the gallery, wait until it is closed
+	if (comicGallery == nullptr || comicViewer != nullptr) { return; }
+	LibraryChange change;
+	{
+		std::lock_guard<std::mutex> guard(libraryLock);
+		libraryChanged.store(false);
+		std::swap(change, libraryChange);
+	}
+	// Only the comics that changed are scanned, the rest stay as they are
+	comicGallery->changeComics(
+		std::vector<std::filesystem::path>(
+			change.added.begin(), change.added.end()),
+		std::vector<std::filesystem::path>(
+			change.removed.begin(), change.removed.end()));
+}
+
+void MyFrame::AddLibraryFolder() {
+	wxDirDialog dialog(
+		this, "Add Library Folder", "",
+		wxDD_DEFAULT_STYLE | wxDD_DIR_MUST_EXIST);
+	if (dialog.ShowModal() == wxID_CANCEL) { return; }
+	const auto first = library.roots().empty();
+	if (!library.addRoot(dialog.GetPath().ToStdString())) { return; }
+	// The watcher walks the new root and reports back through the gallery
+	if (first) { WatchLibrary(); }
+}
+
 void MyFrame::LoadComic() {
+	// A library fills the gallery once the watcher has scanned it
+	const auto watching = !library.roots().empty();
 	std::vector<std::filesystem::path> paths;
-	{
+	if (!watching) {
 		wxFileDialog openFileDialog(
 			this, "Open Comic", "", "",
 			"Comic Files (*.cbr;*.cbz)|*.cbr;*.cbz|"
@@ -142,7 +248,7 @@ void MyFrame::LoadComic() {
 
 	sizer = new wxBoxSizer(wxVERTICAL);
 	comicGallery = new ComicGallery(this, paths);
-	if (comicGallery->length() == 0) {
+	if (!watching && comicGallery->length() == 0) {
 		wxMessageBox("No Valid Comic file found");
 		Close();
 	}
@@ -150,4 +256,5 @@ void MyFrame::LoadComic() {
 
 	SetSizer(sizer);
 	Layout();
+	if (watching) { WatchLibrary(); }
 }
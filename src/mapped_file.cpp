@@ -0,0 +1,158 @@
+#include "mapped_file.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+	: ptr(nullptr),
+	  length(0)
+#ifdef _WIN32
+	  ,
+	  file(nullptr),
+	  mapping(nullptr)
+#endif
+{
+}
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::filesystem::path& filePath) : MappedFile() {
+	auto error = [&]() {
+		auto code = std::error_code(GetLastError(), std::system_category());
+		close();
+		return std::filesystem::filesystem_error(
+			"Unable to map file", filePath, code);
+	};
+	file = CreateFileW(
+		filePath.c_str(), GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		file = nullptr;
+		throw error();
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize)) { throw error(); }
+	if (fileSize.QuadPart == 0) { return; }
+	mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) { throw error(); }
+	ptr = static_cast<const uint8_t*>(
+		MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (ptr == nullptr) { throw error(); }
+	length = static_cast<size_t>(fileSize.QuadPart);
+}
+
+MappedFile MappedFile::copyOf(const uint8_t* data, size_t size) {
+	MappedFile mapped;
+	if (size == 0) { return mapped; }
+	const auto bytes = static_cast<uint64_t>(size);
+	mapped.mapping = CreateFileMappingW(
+		INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+		static_cast<DWORD>(bytes >> 32), static_cast<DWORD>(bytes), nullptr);
+	if (mapped.mapping == nullptr) {
+		throw std::system_error(
+			GetLastError(), std::system_category(), "Unable to map memory");
+	}
+	auto view = MapViewOfFile(mapped.mapping, FILE_MAP_WRITE, 0, 0, size);
+	if (view == nullptr) {
+		throw std::system_error(
+			GetLastError(), std::system_category(), "Unable to map memory");
+	}
+	std::memcpy(view, data, size);
+	mapped.ptr = static_cast<const uint8_t*>(view);
+	mapped.length = size;
+	return mapped;
+}
+
+void MappedFile::close() {
+	if (ptr != nullptr) { UnmapViewOfFile(ptr); }
+	if (mapping != nullptr) { CloseHandle(mapping); }
+	if (file != nullptr) { CloseHandle(file); }
+	ptr = nullptr;
+	length = 0;
+	mapping = nullptr;
+	file = nullptr;
+}
+#else
+MappedFile::MappedFile(const std::filesystem::path& filePath) : MappedFile() {
+	auto error = [&]() {
+		return std::filesystem::filesystem_error(
+			"Unable to map file", filePath,
+			std::error_code(errno, std::generic_category()));
+	};
+	auto fd = open(filePath.c_str(), O_RDONLY);
+	if (fd < 0) { throw error(); }
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		auto e = error();
+		::close(fd);
+		throw e;
+	}
+	if (info.st_size > 0) {
+		auto address =
+			mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (address == MAP_FAILED) {
+			auto e = error();
+			::close(fd);
+			throw e;
+		}
+		ptr = static_cast<const uint8_t*>(address);
+		length = static_cast<size_t>(info.st_size);
+	}
+	// The mapping stays valid after the descriptor is closed
+	::close(fd);
+}
+
+MappedFile MappedFile::copyOf(const uint8_t* data, size_t size) {
+	MappedFile mapped;
+	if (size == 0) { return mapped; }
+	auto address = mmap(
+		nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+		-1, 0);
+	if (address == MAP_FAILED) {
+		throw std::system_error(
+			errno, std::generic_category(), "Unable to map memory");
+	}
+	std::memcpy(address, data, size);
+	// Read-only from here on, like a mapped file
+	mprotect(address, size, PROT_READ);
+	mapped.ptr = static_cast<const uint8_t*>(address);
+	mapped.length = size;
+	return mapped;
+}
+
+void MappedFile::close() {
+	if (ptr != nullptr) { munmap(const_cast<uint8_t*>(ptr), length); }
+	ptr = nullptr;
+	length = 0;
+}
+#endif
+
+MappedFile::~MappedFile() { close(); }
+
+MappedFile::MappedFile(MappedFile&& other) noexcept : MappedFile() {
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	if (this != &other) {
+		close();
+		std::swap(ptr, other.ptr);
+		std::swap(length, other.length);
+#ifdef _WIN32
+		std::swap(file, other.file);
+		std::swap(mapping, other.mapping);
+#endif
+	}
+	return *this;
+}
@@ -0,0 +1,105 @@
+#include "memory_budget.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+const unsigned long long MB = 1024 * 1024;
+// Used when physical memory can't be read, and as the lower bound
+const unsigned long long MIN_BUDGET = 128 * MB;
+
+MemoryBudget::MemoryBudget(unsigned long long totalBytes)
+	: totalBytes(totalBytes), nextId(0), activeId(-1) {}
+
+MemoryBudget& MemoryBudget::get() {
+	static MemoryBudget budget(defaultMemoryBudget(
+		std::getenv("COMIC_READER_MEMORY_MB"), physicalMemory()));
+	return budget;
+}
+
+void MemoryBudget::setTotal(unsigned long long bytes) {
+	std::lock_guard<std::mutex> guard(lock);
+	totalBytes = bytes;
+	rebalance();
+}
+
+int MemoryBudget::add(std::function<void(unsigned long long)> resize) {
+	std::lock_guard<std::mutex> guard(lock);
+	const auto id = nextId++;
+	pools[id].resize = std::move(resize);
+	rebalance();
+	return id;
+}
+
+void MemoryBudget::remove(int id) {
+	std::lock_guard<std::mutex> guard(lock);
+	pools.erase(id);
+	if (activeId == id) { activeId = -1; }
+	rebalance();
+}
+
+void MemoryBudget::activate(int id) {
+	std::lock_guard<std::mutex> guard(lock);
+	if (activeId == id || pools.count(id) == 0) { return; }
+	activeId = id;
+	rebalance();
+}
+
+void MemoryBudget::rebalance() {
+	if (pools.empty()) { return; }
+	const auto active = pools.count(activeId) > 0;
+	const auto others = pools.size() - (active ? 1 : 0);
+	auto activeBytes = totalBytes, otherBytes = 0ull;
+	if (others > 0) {
+		if (active) {
+			activeBytes =
+				static_cast<unsigned long long>(totalBytes * ACTIVE_SHARE);
+		}
+		otherBytes = (totalBytes - (active ? activeBytes : 0)) / others;
+	}
+	auto update = [&](bool shrinking) {
+		for (auto& [id, pool] : pools) {
+			const auto bytes = id == activeId ? activeBytes : otherBytes;
+			if ((bytes < pool.bytes) == shrinking && bytes != pool.bytes) {
+				pool.bytes = bytes;
+				pool.resize(bytes);
+			}
+		}
+	};
+	// Shrink first so the pools never hold more than the total in between
+	update(true);
+	update(false);
+}
+
+unsigned long long defaultMemoryBudget(
+	const char* override, unsigned long long physicalBytes) {
+	if (override != nullptr) {
+		try {
+			const auto mb = std::stoull(override);
+			if (mb > 0) { return mb * MB; }
+		} catch (const std::exception&) {
+		}
+	}
+	return std::max(MIN_BUDGET, physicalBytes / 8);
+}
+
+unsigned long long physicalMemory() {
+#ifdef _WIN32
+	MEMORYSTATUSEX status;
+	status.dwLength = sizeof(status);
+	if (!GlobalMemoryStatusEx(&status)) { return 0; }
+	return status.ullTotalPhys;
+#else
+	const auto pages = sysconf(_SC_PHYS_PAGES);
+	const auto pageSize = sysconf(_SC_PAGE_SIZE);
+	if (pages <= 0 || pageSize <= 0) { return 0; }
+	return static_cast<unsigned long long>(pages) * pageSize;
+#endif
+}
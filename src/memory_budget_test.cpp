@@ -0,0 +1,51 @@
+#include "memory_budget.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+TEST(memoryBudget, SplitsBetweenPools) {
+	MemoryBudget budget(1000);
+	unsigned long long a = 0, b = 0;
+	const auto first = budget.add([&a](auto bytes) { a = bytes; });
+	EXPECT_EQ(a, 1000);
+
+	const auto second = budget.add([&b](auto bytes) { b = bytes; });
+	EXPECT_EQ(a, 500);
+	EXPECT_EQ(b, 500);
+
+	budget.activate(second);
+	EXPECT_EQ(a, 250);
+	EXPECT_EQ(b, 750);
+	budget.activate(first);
+	EXPECT_EQ(a, 750);
+	EXPECT_EQ(b, 250);
+
+	budget.setTotal(2000);
+	EXPECT_EQ(a, 1500);
+	EXPECT_EQ(b, 500);
+
+	budget.remove(first);
+	EXPECT_EQ(b, 2000);
+}
+
+TEST(memoryBudget, ShrinksBeforeGrowing) {
+	MemoryBudget budget(1000);
+	unsigned long long a = 0, b = 0, peak = 0;
+	auto track = [&](unsigned long long& share, unsigned long long bytes) {
+		share = bytes;
+		peak = std::max(peak, a + b);
+	};
+	budget.add([&](auto bytes) { track(a, bytes); });
+	const auto second = budget.add([&](auto bytes) { track(b, bytes); });
+	budget.activate(second);
+	EXPECT_LE(peak, 1000);
+}
+
+TEST(memoryBudget, Default) {
+	const unsigned long long MB = 1024 * 1024;
+	EXPECT_EQ(defaultMemoryBudget("300", 8192 * MB), 300 * MB);
+	EXPECT_EQ(defaultMemoryBudget(nullptr, 8192 * MB), 1024 * MB);
+	EXPECT_EQ(defaultMemoryBudget("junk", 8192 * MB), 1024 * MB);
+	EXPECT_EQ(defaultMemoryBudget(nullptr, 0), 128 * MB);
+}
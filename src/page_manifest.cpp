@@ -0,0 +1,151 @@
+#include "page_manifest.hpp"
+
+#include <wx/string.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include "image_utils.hpp"
+
+const char MANIFEST_MAGIC[8] = {'C', 'R', 'M', 'A', 'N', '0', '0', '1'};
+// Longest string accepted while reading, guards against corrupt lengths
+const uint32_t MAX_STRING_LENGTH = 1 << 16;
+
+template <typename T> void writeValue(std::ostream& out, const T& value) {
+	out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void writeValue(std::ostream& out, const std::string& value) {
+	writeValue(out, static_cast<uint32_t>(value.size()));
+	out.write(value.data(), value.size());
+}
+
+template <typename T> bool readValue(std::istream& in, T& value) {
+	in.read(reinterpret_cast<char*>(&value), sizeof(T));
+	return static_cast<bool>(in);
+}
+
+bool readValue(std::istream& in, std::string& value) {
+	uint32_t length = 0;
+	if (!readValue(in, length) || length > MAX_STRING_LENGTH) {
+		return false;
+	}
+	value.resize(length);
+	in.read(value.data(), length);
+	return static_cast<bool>(in);
+}
+
+bool pageOrder(const std::filesystem::path& a, const std::filesystem::path& b) {
+	return wxCmpNatural(a.string(), b.string()) < 0;
+}
+
+PageManifest PageManifest::build(const ArchiveIndex& index) {
+	PageManifest manifest;
+	manifest.stamp =
+		archiveStamp(index.path()).value_or(ArchiveStamp{-1, -1});
+	manifest.seekable = index.isSeekable();
+	manifest.entries = index.files();
+	const auto& entries = manifest.entries;
+	for (auto i = 0u; i < entries.size(); ++i) {
+		if (isImage(entries[i].path)) { manifest.pages.push_back(i); }
+	}
+	std::sort(
+		manifest.pages.begin(), manifest.pages.end(),
+		[&](const auto& a, const auto& b) {
+			return pageOrder(entries[a].path, entries[b].path);
+		});
+	manifest.sizes.assign(manifest.pages.size(), wxDefaultSize);
+	return manifest;
+}
+
+std::optional<PageManifest> PageManifest::load(
+	const std::filesystem::path& archivePath,
+	const std::filesystem::path& manifestPath) {
+	const auto stamp = archiveStamp(archivePath);
+	if (!stamp) { return std::nullopt; }
+	std::ifstream in(manifestPath, std::ios::binary);
+	if (!in) { return std::nullopt; }
+
+	char magic[sizeof(MANIFEST_MAGIC)];
+	std::string key;
+	PageManifest manifest;
+	uint8_t seekable = 0;
+	if (!readValue(in, magic) ||
+		!std::equal(std::begin(magic), std::end(magic), MANIFEST_MAGIC) ||
+		!readValue(in, key) || key != archivePath.string() ||
+		!readValue(in, manifest.stamp.size) ||
+		!readValue(in, manifest.stamp.time) || manifest.stamp != *stamp ||
+		!readValue(in, seekable)) {
+		return std::nullopt;
+	}
+	manifest.seekable = seekable != 0;
+
+	uint32_t count = 0;
+	if (!readValue(in, count)) { return std::nullopt; }
+	for (auto i = 0u; i < count; ++i) {
+		std::string path;
+		ArchiveEntry entry;
+		int32_t method = 0;
+		if (!readValue(in, path) || !readValue(in, entry.size) ||
+			!readValue(in, entry.offset) ||
+			!readValue(in, entry.compressedSize) || !readValue(in, method)) {
+			return std::nullopt;
+		}
+		entry.path = path;
+		entry.method = method;
+		manifest.entries.push_back(entry);
+	}
+
+	if (!readValue(in, count)) { return std::nullopt; }
+	for (auto i = 0u; i < count; ++i) {
+		uint32_t page = 0;
+		int32_t width = 0, height = 0;
+		if (!readValue(in, page) || !readValue(in, width) ||
+			!readValue(in, height) || page >= manifest.entries.size()) {
+			return std::nullopt;
+		}
+		manifest.pages.push_back(page);
+		manifest.sizes.emplace_back(width, height);
+	}
+	return manifest;
+}
+
+void PageManifest::save(
+	const std::filesystem::path& archivePath,
+	const std::filesystem::path& manifestPath) const {
+	std::filesystem::create_directories(manifestPath.parent_path());
+	auto tempPath = manifestPath;
+	tempPath += ".tmp";
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		out.write(MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC));
+		writeValue(out, archivePath.string());
+		writeValue(out, stamp.size);
+		writeValue(out, stamp.time);
+		writeValue(out, static_cast<uint8_t>(seekable));
+
+		writeValue(out, static_cast<uint32_t>(entries.size()));
+		for (const auto& entry : entries) {
+			writeValue(out, entry.path.string());
+			writeValue(out, entry.size);
+			writeValue(out, entry.offset);
+			writeValue(out, entry.compressedSize);
+			writeValue(out, static_cast<int32_t>(entry.method));
+		}
+
+		writeValue(out, static_cast<uint32_t>(pages.size()));
+		for (auto i = 0u; i < pages.size(); ++i) {
+			writeValue(out, pages[i]);
+			writeValue(out, static_cast<int32_t>(sizes[i].GetWidth()));
+			writeValue(out, static_cast<int32_t>(sizes[i].GetHeight()));
+		}
+		out.flush();
+		if (!out) {
+			throw std::filesystem::filesystem_error(
+				"Unable to write page manifest", tempPath,
+				std::make_error_code(std::errc::io_error));
+		}
+	}
+	// Replace in one step so a crash never leaves a half written manifest
+	std::filesystem::rename(tempPath, manifestPath);
+}
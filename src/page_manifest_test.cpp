@@ -0,0 +1,36 @@
+#include "page_manifest.hpp"
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+
+#include "fixtures.hpp"
+
+TEST(pageManifest, RoundTrip) {
+	const auto tempDir = uniqueTempDirectory("comic_reader_manifest");
+	const auto archive = tempDir / "test.zip";
+	const auto manifestPath = tempDir / "test.manifest";
+	std::filesystem::copy_file("testdata/test.zip", archive);
+
+	auto manifest = PageManifest::build(ArchiveIndex(archive));
+	ASSERT_EQ(manifest.pages.size(), 1);
+	EXPECT_EQ(manifest.entries[manifest.pages[0]].path, "test.png");
+	EXPECT_EQ(manifest.sizes[0], wxDefaultSize);
+	manifest.sizes[0] = wxSize(40, 30);
+	manifest.save(archive, manifestPath);
+
+	auto loaded = PageManifest::load(archive, manifestPath);
+	ASSERT_TRUE(loaded);
+	EXPECT_TRUE(loaded->seekable);
+	EXPECT_EQ(loaded->entries.size(), manifest.entries.size());
+	EXPECT_EQ(loaded->pages, manifest.pages);
+	EXPECT_EQ(loaded->sizes[0], wxSize(40, 30));
+	const auto& entry = loaded->entries[loaded->pages[0]];
+	EXPECT_EQ(entry.offset, manifest.entries[manifest.pages[0]].offset);
+
+	// Any change to the archive invalidates the manifest
+	std::ofstream(archive, std::ios::app | std::ios::binary) << "x";
+	EXPECT_FALSE(PageManifest::load(archive, manifestPath));
+
+	std::filesystem::remove_all(tempDir);
+}
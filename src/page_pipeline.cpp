@@ -0,0 +1,139 @@
+#include "page_pipeline.hpp"
+
+#include <wx/log.h>
+
+#include <algorithm>
+#include <exception>
+
+// Thrown through processArchiveFile to stop reading early
+struct PipelineStopped {};
+
+PagePipeline::PagePipeline(
+	const std::filesystem::path& archivePath, std::function<void()> ready,
+	unsigned int workers, size_t depth, PageDecoder decoder)
+	: archivePath(archivePath),
+	  depth(std::max<size_t>(depth, 1)),
+	  ready(std::move(ready)),
+	  decoder(std::move(decoder)),
+	  decoding(0),
+	  extractedCount(0),
+	  takenCount(0),
+	  extracting(true),
+	  stopping(false) {
+	// One core is left to the extractor
+	if (workers == 0) {
+		workers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+	}
+	for (auto i = 0u; i < workers; ++i) {
+		decoders.emplace_back(&PagePipeline::decode, this);
+	}
+	extractor = std::thread(&PagePipeline::extract, this);
+}
+
+PagePipeline::~PagePipeline() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	space.notify_all();
+	work.notify_all();
+	extractor.join();
+	for (auto& decoder : decoders) { decoder.join(); }
+}
+
+void PagePipeline::extract() {
+	try {
+		processArchiveFile(archivePath, [this](const ArchiveFile& file) {
+			if (!file.isFile()) { return; }
+			ArchiveEntry entry{
+				file.path(), file.size(), file.offset(), -1, -1};
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				entries.push_back(entry);
+			}
+			if (!isImage(entry.path)) { return; }
+			auto content = file.readContent();
+
+			std::unique_lock<std::mutex> guard(lock);
+			// Pages waiting to be decoded, being decoded or waiting to be
+			// taken all count against the depth
+			space.wait(guard, [this]() {
+				return stopping ||
+					   extracted.size() + decoding + decoded.size() < depth;
+			});
+			if (stopping) { throw PipelineStopped(); }
+			extracted.push_back(
+				{extractedCount++, std::move(entry), std::move(content)});
+			work.notify_one();
+		});
+	} catch (const PipelineStopped&) {
+	} catch (const std::exception& e) {
+		wxLogTrace(
+			"pipeline", "Unable to stream %s: %s", archivePath.string(),
+			e.what());
+	}
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		extracting = false;
+	}
+	work.notify_all();
+	if (ready) { ready(); }
+}
+
+void PagePipeline::decode() {
+	std::unique_lock<std::mutex> guard(lock);
+	while (true) {
+		work.wait(guard, [this]() {
+			return stopping || !extracted.empty() || !extracting;
+		});
+		if (stopping || extracted.empty()) { return; }
+		auto job = std::move(extracted.front());
+		extracted.pop_front();
+		++decoding;
+		guard.unlock();
+
+		StreamedPage page{std::move(job.entry), DecodedImage()};
+		try {
+			page.decoded = decoder ? decoder(job.content, page.entry.path)
+								   : decodeImage(job.content, page.entry.path);
+		} catch (const std::exception& e) {
+			wxLogTrace(
+				"pipeline", "Unable to decode %s: %s", page.entry.path.string(),
+				e.what());
+		}
+
+		guard.lock();
+		--decoding;
+		decoded[job.order] = page;
+		// wxImage isn't thread safe, drop this thread's reference under the
+		// lock
+		page.decoded.image.UnRef();
+		guard.unlock();
+		if (ready) { ready(); }
+		guard.lock();
+	}
+}
+
+std::vector<StreamedPage> PagePipeline::take() {
+	std::vector<StreamedPage> pages;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		for (auto it = decoded.find(takenCount); it != decoded.end();
+			 it = decoded.find(++takenCount)) {
+			pages.push_back(it->second);
+			decoded.erase(it);
+		}
+	}
+	space.notify_one();
+	return pages;
+}
+
+bool PagePipeline::done() {
+	std::lock_guard<std::mutex> guard(lock);
+	return !extracting && takenCount == extractedCount;
+}
+
+std::vector<ArchiveEntry> PagePipeline::files() {
+	std::lock_guard<std::mutex> guard(lock);
+	return entries;
+}
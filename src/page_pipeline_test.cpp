@@ -0,0 +1,93 @@
+#include "page_pipeline.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include "fixtures.hpp"
+
+class PagePipelineTest
+	: public ::testing::TestWithParam<std::filesystem::path> {};
+
+TEST_P(PagePipelineTest, StreamsEveryPage) {
+	wxInitAllImageHandlers();
+	std::atomic_int notified(0);
+	PagePipeline pipeline(
+		GetParam(), [&notified]() { ++notified; }, 2, 1);
+
+	std::vector<StreamedPage> pages;
+	for (int i = 0; i < 500 && !pipeline.done(); ++i) {
+		for (auto& page : pipeline.take()) { pages.push_back(page); }
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	ASSERT_TRUE(pipeline.done());
+	EXPECT_GT(notified.load(), 0);
+	ASSERT_EQ(pages.size(), 1);
+	EXPECT_EQ(pages[0].entry.path, "test.png");
+	EXPECT_EQ(pages[0].decoded.size, wxSize(953, 272));
+	EXPECT_EQ(pipeline.files().size(), 3);
+}
+
+TEST(pagePipeline, StopsEarly) {
+	for (const auto archive : {ArchiveFormat::Zip, ArchiveFormat::SevenZip}) {
+		ComicFixture fixture;
+		fixture.pages = 64;
+		fixture.pageSize = wxSize(64, 96);
+		fixture.archive = archive;
+		std::atomic_int notified(0);
+		auto pipeline = std::make_unique<PagePipeline>(
+			fixtureComic(fixture), [&notified]() { ++notified; }, 1, 2);
+
+		// Nothing is taken, so the extractor ends up blocked on a full queue
+		for (int i = 0; i < 500 && notified.load() < 2; ++i) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		EXPECT_FALSE(pipeline->done());
+		EXPECT_LT(pipeline->files().size(), size_t(fixture.pages));
+
+		const auto start = std::chrono::steady_clock::now();
+		pipeline.reset();
+		EXPECT_LT(
+			std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+		// No thread is left to call back
+		const auto stopped = notified.load();
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		EXPECT_EQ(notified.load(), stopped);
+	}
+}
+
+TEST(pagePipeline, BoundsPagesInFlight) {
+	ComicFixture fixture;
+	fixture.pages = 32;
+	fixture.pageSize = wxSize(64, 96);
+	const size_t depth = 2;
+	std::atomic_int started(0);
+	PagePipeline pipeline(
+		fixtureComic(fixture), nullptr, 4, depth,
+		[&started](const auto& content, const auto& name) {
+			++started;
+			// Slower than the extractor, so decoders are always busy
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			return decodeImage(content, name);
+		});
+
+	// Nothing is taken, pages being decoded count against the depth
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	EXPECT_LE(started.load(), int(depth));
+
+	std::vector<StreamedPage> pages;
+	for (int i = 0; i < 500 && !pipeline.done(); ++i) {
+		for (auto& page : pipeline.take()) { pages.push_back(page); }
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	ASSERT_TRUE(pipeline.done());
+	EXPECT_EQ(pages.size(), size_t(fixture.pages));
+}
+
+INSTANTIATE_TEST_SUITE_P(
+	PagePipeline, PagePipelineTest,
+	::testing::Values("testdata/test.zip", "testdata/test.rar"));
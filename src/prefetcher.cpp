@@ -0,0 +1,111 @@
+#include "prefetcher.hpp"
+
+#include <wx/log.h>
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+
+Prefetcher::Prefetcher(std::function<void(int)> job, unsigned int workers)
+	: job(std::move(job)), stopping(false) {
+	for (auto i = 0u; i < std::max(workers, 1u); ++i) {
+		this->workers.emplace_back(&Prefetcher::run, this);
+	}
+}
+
+Prefetcher::~Prefetcher() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+		queue.clear();
+	}
+	wake.notify_all();
+	for (auto& worker : workers) { worker.join(); }
+}
+
+void Prefetcher::schedule(int index, int priority) {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		auto it = std::find_if(queue.begin(), queue.end(), [index](auto& e) {
+			return e.second == index;
+		});
+		if (it == queue.end()) {
+			queue.emplace_back(priority, index);
+		} else {
+			it->first = std::max(it->first, priority);
+		}
+	}
+	wake.notify_one();
+}
+
+void Prefetcher::cancel() {
+	std::lock_guard<std::mutex> guard(lock);
+	queue.clear();
+}
+
+void Prefetcher::run() {
+	std::unique_lock<std::mutex> guard(lock);
+	auto next = queue.end();
+	auto pick = [&]() {
+		next = queue.end();
+		for (auto it = queue.begin(); it != queue.end(); ++it) {
+			if (running.count(it->second) == 0 &&
+				(next == queue.end() || *next < *it)) {
+				next = it;
+			}
+		}
+		return next != queue.end();
+	};
+	while (true) {
+		wake.wait(guard, [&]() { return stopping || pick(); });
+		if (stopping) { return; }
+		const auto index = next->second;
+		queue.erase(next);
+		running.insert(index);
+
+		guard.unlock();
+		try {
+			job(index);
+		} catch (const std::exception& e) {
+			wxLogTrace(
+				"prefetch", "Prefetch of %d failed: %s", index, e.what());
+		}
+		guard.lock();
+		running.erase(index);
+		// The same index may have been scheduled again meanwhile
+		wake.notify_all();
+	}
+}
+
+NavigationTracker::NavigationTracker() : pagesPerSecond(0), direction(1) {}
+
+std::vector<std::pair<int, int>> NavigationTracker::onNavigate(
+	int from, int to, int count, Clock::time_point now) {
+	const auto step = to - from;
+	const auto seconds =
+		std::chrono::duration<double>(now - lastMove).count();
+	lastMove = now;
+
+	// Smoothed rate of single page turns, anything else resets it
+	if (std::abs(step) == 1 && seconds > 0 && seconds < 5) {
+		pagesPerSecond = 0.5 * pagesPerSecond + 0.5 / seconds;
+	} else {
+		pagesPerSecond = 0;
+	}
+	if (step != 0) { direction = step > 0 ? 1 : -1; }
+
+	std::vector<std::pair<int, int>> indices;
+	auto add = [&](int i, int priority) {
+		if (i >= 0 && i < count && i != to) {
+			indices.emplace_back(i, priority);
+		}
+	};
+
+	const int ahead = pagesPerSecond > 1.0 ? 3 : 2;
+	for (int d = 1; d <= ahead; ++d) {
+		add(to + direction * d, 1 + ahead - d);
+	}
+	// After a jump either way is plausible, keep the other neighbour too
+	if (std::abs(step) > 1) { add(to - direction, 0); }
+	return indices;
+}
@@ -0,0 +1,80 @@
+#include "prefetcher.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <future>
+
+using ::testing::ElementsAre;
+using ::testing::Pair;
+
+TEST(navigationTracker, ReadsAheadInDirection) {
+	NavigationTracker tracker;
+	auto now = std::chrono::steady_clock::now();
+	EXPECT_THAT(
+		tracker.onNavigate(0, 1, 10, now), ElementsAre(Pair(2, 2), Pair(3, 1)));
+	EXPECT_THAT(
+		tracker.onNavigate(1, 0, 10, now + std::chrono::seconds(3)),
+		ElementsAre());
+}
+
+TEST(navigationTracker, LooksFurtherWhenPagingQuickly) {
+	NavigationTracker tracker;
+	auto now = std::chrono::steady_clock::now();
+	tracker.onNavigate(0, 1, 10, now);
+	now += std::chrono::milliseconds(200);
+	EXPECT_THAT(
+		tracker.onNavigate(1, 2, 10, now),
+		ElementsAre(Pair(3, 3), Pair(4, 2), Pair(5, 1)));
+}
+
+TEST(navigationTracker, BackwardJumpPrefetchesPreviousPages) {
+	NavigationTracker tracker;
+	EXPECT_THAT(
+		tracker.onNavigate(8, 3, 10),
+		ElementsAre(Pair(2, 2), Pair(1, 1), Pair(4, 0)));
+}
+
+TEST(prefetcher, RunsHighestPriorityFirst) {
+	std::promise<void> started, gate, done;
+	std::vector<int> order;
+
+	Prefetcher prefetcher([&](int i) {
+		if (i == 0) {
+			started.set_value();
+			gate.get_future().wait();
+		}
+		order.push_back(i);
+		if (i == 4) { done.set_value(); }
+	});
+	// Hold the worker on the first job while the queue fills up
+	prefetcher.schedule(0, 0);
+	started.get_future().wait();
+	prefetcher.schedule(1, 1);
+	prefetcher.cancel();
+	prefetcher.schedule(2, 5);
+	prefetcher.schedule(3, 3);
+	prefetcher.schedule(4, 1);
+	gate.set_value();
+	done.get_future().wait();
+
+	EXPECT_THAT(order, ElementsAre(0, 2, 3, 4));
+}
+
+TEST(prefetcher, RunsJobsInParallel) {
+	std::promise<void> first, second, done;
+	std::atomic_int finished(0);
+	// Each job waits for the other, so they can only finish side by side
+	Prefetcher prefetcher(
+		[&](int i) {
+			(i == 0 ? first : second).set_value();
+			(i == 0 ? second : first).get_future().wait();
+			if (++finished == 2) { done.set_value(); }
+		},
+		2);
+	prefetcher.schedule(0, 0);
+	prefetcher.schedule(1, 0);
+	done.get_future().wait();
+	EXPECT_EQ(finished.load(), 2);
+}
@@ -0,0 +1,340 @@
+#include "resample.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "trace.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+	defined(_M_IX86)
+#define RESAMPLE_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+// Weights are fixed point with this many fractional bits, small enough for
+// pairs of them times 255 to be summed in 32 bits
+const int PRECISION = 14;
+const int ROUNDING = 1 << (PRECISION - 1);
+// Rows are copied with this much slack, kernels load 4 bytes per pixel
+const int ROW_PADDING = 4;
+const double PI = 3.14159265358979323846;
+
+// Contributions of the source pixels to each destination pixel, every one
+// uses `taps` consecutive pixels from `start`
+struct Coefficients {
+	int taps = 0;
+	std::vector<int> start;
+	std::vector<int16_t> weights;  // taps per destination pixel
+};
+
+double sinc(double x) {
+	if (x == 0.0) { return 1.0; }
+	x *= PI;
+	return std::sin(x) / x;
+}
+
+double boxFilter(double x) { return x >= -0.5 && x < 0.5 ? 1.0 : 0.0; }
+
+double lanczos3(double x) {
+	return x > -3.0 && x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+}
+
+Coefficients coefficients(int in, int out, ResampleFilter filter) {
+	const auto f = filter == ResampleFilter::Box ? boxFilter : lanczos3;
+	const double support = filter == ResampleFilter::Box ? 0.5 : 3.0;
+	const double scale = double(in) / out;
+	// Downscaling stretches the filter over the source pixels it covers
+	const double stretch = std::max(scale, 1.0);
+
+	Coefficients c;
+	c.taps = std::min(in, int(std::ceil(support * stretch)) * 2 + 1);
+	c.start.resize(out);
+	c.weights.assign(size_t(out) * c.taps, 0);
+
+	std::vector<double> w(c.taps);
+	for (int x = 0; x < out; ++x) {
+		const double center = (x + 0.5) * scale;
+		const int first = std::max(0, int(center - support * stretch + 0.5));
+		const int last = std::min(
+			{in, int(center + support * stretch + 0.5), first + c.taps});
+		// Near the right edge the window shifts left to stay in bounds
+		const int start = std::min(first, in - c.taps);
+		c.start[x] = start;
+
+		double total = 0;
+		std::fill(w.begin(), w.end(), 0.0);
+		for (int i = first; i < last; ++i) {
+			w[i - start] = f((i - center + 0.5) / stretch);
+			total += w[i - start];
+		}
+		if (total == 0) {
+			w[std::clamp(int(center) - start, 0, c.taps - 1)] = total = 1;
+		}
+
+		auto* fixed = &c.weights[size_t(x) * c.taps];
+		int sum = 0, largest = 0;
+		for (int k = 0; k < c.taps; ++k) {
+			fixed[k] = int16_t(std::lround(w[k] / total * (1 << PRECISION)));
+			sum += fixed[k];
+			if (fixed[k] > fixed[largest]) { largest = k; }
+		}
+		// Rounding may leave the sum off by a little, which shows as a tint
+		fixed[largest] += (1 << PRECISION) - sum;
+	}
+	return c;
+}
+
+uint8_t clampPixel(int value) {
+	return uint8_t(std::clamp((value + ROUNDING) >> PRECISION, 0, 255));
+}
+
+void horizontalScalar(
+	const uint8_t* row, uint8_t* out, int width, int channels,
+	const Coefficients& c) {
+	for (int x = 0; x < width; ++x) {
+		const auto* w = &c.weights[size_t(x) * c.taps];
+		const auto* p = row + c.start[x] * channels;
+		for (int ch = 0; ch < channels; ++ch) {
+			int sum = 0;
+			for (int k = 0; k < c.taps; ++k) {
+				sum += w[k] * p[k * channels + ch];
+			}
+			out[x * channels + ch] = clampPixel(sum);
+		}
+	}
+}
+
+void verticalScalar(
+	const uint8_t* const* rows, const int16_t* w, int taps, uint8_t* out,
+	int bytes) {
+	for (int i = 0; i < bytes; ++i) {
+		int sum = 0;
+		for (int k = 0; k < taps; ++k) { sum += w[k] * rows[k][i]; }
+		out[i] = clampPixel(sum);
+	}
+}
+
+#ifdef RESAMPLE_X86
+
+// Two 16 bit weights in one 32 bit lane, for madd
+__m128i weightPair(int16_t a, int16_t b) {
+	return _mm_set1_epi32(int(uint16_t(a)) | (int(uint16_t(b)) << 16));
+}
+
+int32_t load32(const uint8_t* p) {
+	int32_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+// All channels of a pixel at once, up to 4 in the 32 bit lanes. Taps are
+// taken in pairs so their channels can be interleaved for madd.
+void horizontalSSE2(
+	const uint8_t* row, uint8_t* out, int width, int channels,
+	const Coefficients& c) {
+	const auto zero = _mm_setzero_si128();
+	for (int x = 0; x < width; ++x) {
+		const auto* w = &c.weights[size_t(x) * c.taps];
+		const auto* p = row + c.start[x] * channels;
+		auto sum = _mm_set1_epi32(ROUNDING);
+		for (int k = 0; k < c.taps; k += 2) {
+			const auto second = k + 1 < c.taps;
+			const auto* q = p + k * channels;
+			const auto a = _mm_cvtsi32_si128(load32(q));
+			const auto b =
+				second ? _mm_cvtsi32_si128(load32(q + channels)) : zero;
+			auto v = _mm_unpacklo_epi8(_mm_unpacklo_epi32(a, b), zero);
+			v = _mm_unpacklo_epi16(v, _mm_unpackhi_epi64(v, v));
+			const auto weights = weightPair(w[k], second ? w[k + 1] : 0);
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(v, weights));
+		}
+		sum = _mm_srai_epi32(sum, PRECISION);
+		sum = _mm_packus_epi16(_mm_packs_epi32(sum, sum), zero);
+		const auto pixel = _mm_cvtsi128_si32(sum);
+		std::memcpy(out + x * channels, &pixel, channels);
+	}
+}
+
+// 8 bytes of the row at a time, taps in pairs as in horizontalSSE2
+void verticalSSE2(
+	const uint8_t* const* rows, const int16_t* w, int taps, uint8_t* out,
+	int bytes) {
+	const auto zero = _mm_setzero_si128();
+	int i = 0;
+	for (; i + 8 <= bytes; i += 8) {
+		auto lo = _mm_set1_epi32(ROUNDING), hi = lo;
+		for (int k = 0; k < taps; k += 2) {
+			const auto second = k + 1 < taps;
+			const auto a = _mm_unpacklo_epi8(
+				_mm_loadl_epi64(reinterpret_cast<const __m128i*>(rows[k] + i)),
+				zero);
+			const auto b =
+				second ? _mm_unpacklo_epi8(
+							 _mm_loadl_epi64(reinterpret_cast<const __m128i*>(
+								 rows[k + 1] + i)),
+							 zero)
+					   : zero;
+			const auto weights = weightPair(w[k], second ? w[k + 1] : 0);
+			lo = _mm_add_epi32(
+				lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), weights));
+			hi = _mm_add_epi32(
+				hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), weights));
+		}
+		lo = _mm_srai_epi32(lo, PRECISION);
+		hi = _mm_srai_epi32(hi, PRECISION);
+		const auto packed =
+			_mm_packus_epi16(_mm_packs_epi32(lo, hi), zero);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), packed);
+	}
+	if (i < bytes) {
+		std::vector<const uint8_t*> shifted(taps);
+		for (int k = 0; k < taps; ++k) { shifted[k] = rows[k] + i; }
+		verticalScalar(shifted.data(), w, taps, out + i, bytes - i);
+	}
+}
+
+// 16 bytes of the row at a time. The 256 bit unpacks work within each 128
+// bit half, which puts the packed result in order except for the final
+// cross lane permute.
+TARGET_AVX2 void verticalAVX2(
+	const uint8_t* const* rows, const int16_t* w, int taps, uint8_t* out,
+	int bytes) {
+	int i = 0;
+	for (; i + 16 <= bytes; i += 16) {
+		auto lo = _mm256_set1_epi32(ROUNDING), hi = lo;
+		for (int k = 0; k < taps; k += 2) {
+			const auto second = k + 1 < taps;
+			const auto a = _mm256_cvtepu8_epi16(
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k] + i)));
+			const auto b = second
+							   ? _mm256_cvtepu8_epi16(_mm_loadu_si128(
+									 reinterpret_cast<const __m128i*>(
+										 rows[k + 1] + i)))
+							   : _mm256_setzero_si256();
+			const auto weights = _mm256_set1_epi32(
+				int(uint16_t(w[k])) |
+				(int(uint16_t(second ? w[k + 1] : 0)) << 16));
+			lo = _mm256_add_epi32(
+				lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), weights));
+			hi = _mm256_add_epi32(
+				hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), weights));
+		}
+		lo = _mm256_srai_epi32(lo, PRECISION);
+		hi = _mm256_srai_epi32(hi, PRECISION);
+		auto packed = _mm256_packs_epi32(lo, hi);
+		packed = _mm256_packus_epi16(packed, packed);
+		packed = _mm256_permute4x64_epi64(packed, 0x08);
+		_mm_storeu_si128(
+			reinterpret_cast<__m128i*>(out + i),
+			_mm256_castsi256_si128(packed));
+	}
+	if (i < bytes) {
+		std::vector<const uint8_t*> shifted(taps);
+		for (int k = 0; k < taps; ++k) { shifted[k] = rows[k] + i; }
+		verticalSSE2(shifted.data(), w, taps, out + i, bytes - i);
+	}
+}
+
+bool cpuHasAvx2() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	// The OS has to save the AVX registers as well
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) { return false; }
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+bool resampleKernelSupported(ResampleKernel kernel) {
+	switch (kernel) {
+		case ResampleKernel::Auto:
+		case ResampleKernel::Scalar:
+			return true;
+#ifdef RESAMPLE_X86
+		case ResampleKernel::SSE2:
+			return true;
+		case ResampleKernel::AVX2: {
+			static const bool avx2 = cpuHasAvx2();
+			return avx2;
+		}
+#endif
+		default:
+			return false;
+	}
+}
+
+using HorizontalKernel = void (*)(
+	const uint8_t*, uint8_t*, int, int, const Coefficients&);
+using VerticalKernel =
+	void (*)(const uint8_t* const*, const int16_t*, int, uint8_t*, int);
+
+void resample(
+	const uint8_t* src, int srcWidth, int srcHeight, uint8_t* dst,
+	int dstWidth, int dstHeight, int channels, ResampleFilter filter,
+	ResampleKernel kernel) {
+	TraceSpan span("resample");
+	if (srcWidth <= 0 || srcHeight <= 0 || dstWidth <= 0 || dstHeight <= 0 ||
+		channels < 1 || channels > 4) {
+		throw std::invalid_argument("Invalid image size for resample");
+	}
+	if (kernel == ResampleKernel::Auto) {
+		kernel = resampleKernelSupported(ResampleKernel::AVX2)
+					 ? ResampleKernel::AVX2
+				 : resampleKernelSupported(ResampleKernel::SSE2)
+					 ? ResampleKernel::SSE2
+					 : ResampleKernel::Scalar;
+	}
+	if (!resampleKernelSupported(kernel)) {
+		throw std::invalid_argument("Resample kernel not supported");
+	}
+
+	HorizontalKernel horizontal = horizontalScalar;
+	VerticalKernel vertical = verticalScalar;
+#ifdef RESAMPLE_X86
+	if (kernel != ResampleKernel::Scalar) {
+		horizontal = horizontalSSE2;
+		vertical = kernel == ResampleKernel::AVX2 ? verticalAVX2 : verticalSSE2;
+	}
+#endif
+
+	// Horizontal pass into an intermediate of srcHeight rows
+	const auto cx = coefficients(srcWidth, dstWidth, filter);
+	const auto srcRow = size_t(srcWidth) * channels;
+	const auto dstRow = size_t(dstWidth) * channels;
+	std::vector<uint8_t> padded(srcRow + ROW_PADDING);
+	std::vector<uint8_t> middle(dstRow * srcHeight);
+	for (int y = 0; y < srcHeight; ++y) {
+		std::memcpy(padded.data(), src + y * srcRow, srcRow);
+		horizontal(padded.data(), &middle[y * dstRow], dstWidth, channels, cx);
+	}
+
+	// Vertical pass over whole rows
+	const auto cy = coefficients(srcHeight, dstHeight, filter);
+	std::vector<const uint8_t*> rows(cy.taps);
+	for (int y = 0; y < dstHeight; ++y) {
+		for (int k = 0; k < cy.taps; ++k) {
+			rows[k] = &middle[(cy.start[y] + k) * dstRow];
+		}
+		vertical(
+			rows.data(), &cy.weights[size_t(y) * cy.taps], cy.taps,
+			dst + y * dstRow, int(dstRow));
+	}
+}
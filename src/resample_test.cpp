@@ -0,0 +1,115 @@
+#include "resample.hpp"
+
+#include <benchmark/benchmark.h>
+#include <gtest/gtest.h>
+#include <wx/image.h>
+
+#include <random>
+#include <vector>
+
+#include "image_utils.hpp"
+
+std::vector<uint8_t> noise(int width, int height, int channels) {
+	std::mt19937 gen(7);
+	std::uniform_int_distribution<int> dist(0, 255);
+	std::vector<uint8_t> pixels(size_t(width) * height * channels);
+	for (auto& p : pixels) { p = uint8_t(dist(gen)); }
+	return pixels;
+}
+
+TEST(resample, KernelsAgree) {
+	for (const auto filter : {ResampleFilter::Box, ResampleFilter::Lanczos3}) {
+		for (const int channels : {1, 3, 4}) {
+			for (const auto& [sw, sh, dw, dh] :
+				 {std::tuple{97, 61, 31, 20}, std::tuple{40, 30, 93, 71},
+				  std::tuple{300, 5, 7, 9}}) {
+				const auto src = noise(sw, sh, channels);
+				std::vector<uint8_t> expected(size_t(dw) * dh * channels);
+				resample(
+					src.data(), sw, sh, expected.data(), dw, dh, channels,
+					filter, ResampleKernel::Scalar);
+				for (const auto kernel :
+					 {ResampleKernel::SSE2, ResampleKernel::AVX2}) {
+					if (!resampleKernelSupported(kernel)) { continue; }
+					std::vector<uint8_t> actual(expected.size());
+					resample(
+						src.data(), sw, sh, actual.data(), dw, dh, channels,
+						filter, kernel);
+					EXPECT_EQ(actual, expected);
+				}
+			}
+		}
+	}
+}
+
+TEST(resample, KeepsFlatColour) {
+	std::vector<uint8_t> src(64 * 48 * 3);
+	for (size_t i = 0; i < src.size(); i += 3) {
+		src[i] = 200;
+		src[i + 1] = 10;
+		src[i + 2] = 90;
+	}
+	for (const auto filter : {ResampleFilter::Box, ResampleFilter::Lanczos3}) {
+		std::vector<uint8_t> dst(13 * 10 * 3);
+		resample(src.data(), 64, 48, dst.data(), 13, 10, 3, filter);
+		for (size_t i = 0; i < dst.size(); i += 3) {
+			EXPECT_EQ(dst[i], 200);
+			EXPECT_EQ(dst[i + 1], 10);
+			EXPECT_EQ(dst[i + 2], 90);
+		}
+	}
+}
+
+TEST(resample, BoxAveragesBlocks) {
+	const std::vector<uint8_t> src = {0, 100, 50, 150, 10, 10, 30, 30};
+	std::vector<uint8_t> dst(2);
+	resample(src.data(), 4, 2, dst.data(), 2, 1, 1, ResampleFilter::Box);
+	EXPECT_EQ(dst, (std::vector<uint8_t>{30, 65}));
+}
+
+// A typical scanned page reduced to a gallery thumbnail
+const int PAGE_W = 1988, PAGE_H = 3056, THUMB_W = 703, THUMB_H = 1080;
+
+void BM_Rescale(benchmark::State& state) {
+	const auto pixels = noise(PAGE_W, PAGE_H, 3);
+	wxImage page(PAGE_W, PAGE_H, false);
+	std::copy(pixels.begin(), pixels.end(), page.GetData());
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(
+			page.Scale(THUMB_W, THUMB_H, wxIMAGE_QUALITY_HIGH));
+	}
+}
+BENCHMARK(BM_Rescale)->Unit(benchmark::kMillisecond);
+
+void BM_Resample(benchmark::State& state) {
+	const auto kernel = static_cast<ResampleKernel>(state.range(0));
+	const auto filter = static_cast<ResampleFilter>(state.range(1));
+	if (!resampleKernelSupported(kernel)) {
+		state.SkipWithError("Kernel not supported on this CPU");
+		return;
+	}
+	const auto src = noise(PAGE_W, PAGE_H, 3);
+	std::vector<uint8_t> dst(size_t(THUMB_W) * THUMB_H * 3);
+	for (auto _ : state) {
+		resample(
+			src.data(), PAGE_W, PAGE_H, dst.data(), THUMB_W, THUMB_H, 3,
+			filter, kernel);
+		benchmark::DoNotOptimize(dst.data());
+	}
+}
+BENCHMARK(BM_Resample)
+	->ArgsProduct(
+		{{int(ResampleKernel::Scalar), int(ResampleKernel::SSE2),
+		  int(ResampleKernel::AVX2)},
+		 {int(ResampleFilter::Box), int(ResampleFilter::Lanczos3)}})
+	->Unit(benchmark::kMillisecond);
+
+void BM_ResizeImage(benchmark::State& state) {
+	const auto pixels = noise(PAGE_W, PAGE_H, 3);
+	wxImage page(PAGE_W, PAGE_H, false);
+	std::copy(pixels.begin(), pixels.end(), page.GetData());
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(resizeImage(page, THUMB_W, THUMB_H));
+	}
+}
+BENCHMARK(BM_ResizeImage)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,252 @@
+#include "thumbnail_pack.hpp"
+
+#include <wx/log.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "archive.hpp"
+
+const char PACK_MAGIC[8] = {'C', 'R', 'T', 'P', 'A', 'C', 'K', '1'};
+const uint32_t RECORD_MAGIC = 0x43525452;  // "RTRC"
+
+struct RecordHeader {
+	uint32_t magic;
+	uint32_t keyLength;
+	uint32_t extensionLength;
+	int32_t pages;
+	int64_t archiveSize;
+	int64_t archiveTime;
+	int32_t width;
+	int32_t height;
+	uint64_t dataLength;
+};
+static_assert(sizeof(RecordHeader) == 48, "Record header must be packed");
+
+// Replaced records below this are not worth rewriting the pack for
+const uint64_t COMPACT_MIN_BYTES = 1 << 20;
+
+uint64_t recordSize(const std::string& key, const ThumbnailEntry& entry) {
+	return sizeof(RecordHeader) + key.size() + entry.extension.size() +
+		   entry.length;
+}
+
+// Writes the record and returns the offset of its data
+uint64_t writeRecord(
+	std::ostream& file, uint64_t pos, const std::string& key,
+	const ThumbnailEntry& entry, const uint8_t* data) {
+	RecordHeader header{
+		RECORD_MAGIC,
+		static_cast<uint32_t>(key.size()),
+		static_cast<uint32_t>(entry.extension.size()),
+		entry.pages,
+		entry.archiveSize,
+		entry.archiveTime,
+		entry.width,
+		entry.height,
+		entry.length};
+	file.seekp(pos);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(key.data(), key.size());
+	file.write(entry.extension.data(), entry.extension.size());
+	file.write(reinterpret_cast<const char*>(data), entry.length);
+	return pos + sizeof(RecordHeader) + key.size() + entry.extension.size();
+}
+
+ThumbnailPack::ThumbnailPack(const std::filesystem::path& packPath)
+	: packPath(packPath), validEnd(0), liveBytes(0), enabled(false) {
+	try {
+		std::filesystem::create_directories(packPath.parent_path());
+		if (!std::filesystem::exists(packPath)) { create(); }
+		mapping = MappedFile(packPath);
+		if (mapping.size() < sizeof(PACK_MAGIC) ||
+			std::memcmp(mapping.data(), PACK_MAGIC, sizeof(PACK_MAGIC)) != 0) {
+			mapping.close();
+			create();
+			mapping = MappedFile(packPath);
+		}
+		scan();
+		const auto deadBytes = validEnd - sizeof(PACK_MAGIC) - liveBytes;
+		if (deadBytes > std::max(liveBytes, COMPACT_MIN_BYTES)) {
+			compactLocked();
+		}
+		enabled = true;
+	} catch (const std::exception& e) {
+		wxLogWarning("Thumbnail pack disabled: %s", e.what());
+	}
+}
+
+void ThumbnailPack::create() {
+	std::ofstream file(packPath, std::ios::binary | std::ios::trunc);
+	file.write(PACK_MAGIC, sizeof(PACK_MAGIC));
+	if (!file) {
+		throw std::filesystem::filesystem_error(
+			"Unable to create thumbnail pack", packPath,
+			std::make_error_code(std::errc::io_error));
+	}
+}
+
+void ThumbnailPack::scan() {
+	entries.clear();
+	liveBytes = 0;
+	const auto* data = mapping.data();
+	const uint64_t size = mapping.size();
+	uint64_t pos = sizeof(PACK_MAGIC);
+	while (pos + sizeof(RecordHeader) <= size) {
+		RecordHeader header;
+		std::memcpy(&header, data + pos, sizeof(RecordHeader));
+		const auto payload = uint64_t(header.keyLength) +
+							 header.extensionLength + header.dataLength;
+		if (header.magic != RECORD_MAGIC ||
+			payload > size - pos - sizeof(RecordHeader)) {
+			// Torn write, everything after this gets overwritten
+			break;
+		}
+		const auto* key = data + pos + sizeof(RecordHeader);
+		const auto* extension = key + header.keyLength;
+		const auto offset = pos + sizeof(RecordHeader) + header.keyLength +
+							header.extensionLength;
+		// Later records replace earlier ones for the same archive
+		const std::string name(key, key + header.keyLength);
+		if (auto it = entries.find(name); it != entries.end()) {
+			liveBytes -= recordSize(name, it->second);
+		}
+		entries[name] = {
+			header.archiveSize,
+			header.archiveTime,
+			header.pages,
+			header.width,
+			header.height,
+			std::string(extension, extension + header.extensionLength),
+			offset,
+			header.dataLength};
+		pos += sizeof(RecordHeader) + payload;
+		liveBytes += sizeof(RecordHeader) + payload;
+	}
+	validEnd = pos;
+}
+
+std::optional<ThumbnailEntry> ThumbnailPack::find(
+	const std::filesystem::path& archive) {
+	const auto stamp = archiveStamp(archive);
+	if (!stamp) { return std::nullopt; }
+
+	std::lock_guard<std::mutex> guard(lock);
+	auto it = entries.find(archive.string());
+	if (it == entries.end() || it->second.archiveSize != stamp->size ||
+		it->second.archiveTime != stamp->time) {
+		return std::nullopt;
+	}
+	return it->second;
+}
+
+bool ThumbnailPack::add(
+	const std::filesystem::path& archive, int pages,
+	const Thumbnail& thumbnail) {
+	const auto stamp = archiveStamp(archive);
+	if (!stamp) { return false; }
+	const auto key = archive.string();
+
+	std::lock_guard<std::mutex> guard(lock);
+	if (!enabled) { return false; }
+
+	ThumbnailEntry entry{
+		stamp->size,
+		stamp->time,
+		pages,
+		thumbnail.width,
+		thumbnail.height,
+		thumbnail.extension,
+		0,
+		thumbnail.content.size()};
+
+	std::ofstream file(packPath, std::ios::binary | std::ios::in);
+	entry.offset =
+		writeRecord(file, validEnd, key, entry, thumbnail.content.data());
+	file.flush();
+	if (!file) {
+		// Written from the gallery's loader threads
+		wxLogTrace(
+			"thumbnails", "Unable to write thumbnail for %s",
+			archive.string());
+		return false;
+	}
+
+	if (auto it = entries.find(key); it != entries.end()) {
+		liveBytes -= recordSize(key, it->second);
+	}
+	liveBytes += recordSize(key, entry);
+	validEnd = entry.offset + entry.length;
+	entries[key] = std::move(entry);
+	return true;
+}
+
+std::vector<uint8_t> ThumbnailPack::read(
+	const std::filesystem::path& archive) {
+	std::lock_guard<std::mutex> guard(lock);
+	auto it = entries.find(archive.string());
+	if (it == entries.end()) { return {}; }
+	const auto& entry = it->second;
+	if (entry.offset + entry.length > mapping.size()) {
+		// Written during this session, map the grown file
+		mapping = MappedFile(packPath);
+	}
+	const auto* begin = mapping.data() + entry.offset;
+	return std::vector<uint8_t>(begin, begin + entry.length);
+}
+
+void ThumbnailPack::compact() {
+	std::lock_guard<std::mutex> guard(lock);
+	if (!enabled) { return; }
+	try {
+		compactLocked();
+	} catch (const std::exception& e) {
+		enabled = false;
+		wxLogWarning("Thumbnail pack disabled: %s", e.what());
+	}
+}
+
+void ThumbnailPack::compactLocked() {
+	if (validEnd > mapping.size()) { mapping = MappedFile(packPath); }
+	auto temporary = packPath;
+	temporary += ".tmp";
+
+	std::unordered_map<std::string, ThumbnailEntry> kept;
+	uint64_t pos = sizeof(PACK_MAGIC);
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		file.write(PACK_MAGIC, sizeof(PACK_MAGIC));
+		for (const auto& [key, entry] : entries) {
+			// Records of deleted or changed archives are dropped as well
+			const auto stamp = archiveStamp(key);
+			if (!stamp || stamp->size != entry.archiveSize ||
+				stamp->time != entry.archiveTime) {
+				continue;
+			}
+			auto moved = entry;
+			moved.offset = writeRecord(
+				file, pos, key, entry, mapping.data() + entry.offset);
+			pos = moved.offset + moved.length;
+			kept.emplace(key, std::move(moved));
+		}
+		file.flush();
+		if (!file) {
+			throw std::filesystem::filesystem_error(
+				"Unable to compact thumbnail pack", temporary,
+				std::make_error_code(std::errc::io_error));
+		}
+	}
+
+	// Unmapped first, Windows can't replace a mapped file
+	mapping.close();
+	std::filesystem::rename(temporary, packPath);
+	mapping = MappedFile(packPath);
+	wxLogTrace(
+		"thumbnails", "Compacted thumbnail pack from %llu to %llu bytes",
+		static_cast<unsigned long long>(validEnd),
+		static_cast<unsigned long long>(pos));
+	entries = std::move(kept);
+	validEnd = pos;
+	liveBytes = pos - sizeof(PACK_MAGIC);
+}
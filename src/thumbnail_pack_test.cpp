@@ -0,0 +1,104 @@
+#include "thumbnail_pack.hpp"
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+
+#include "fixtures.hpp"
+
+class ThumbnailPackTest : public ::testing::Test {
+   protected:
+	std::filesystem::path tempDir;
+	std::filesystem::path archive;
+	std::filesystem::path packPath;
+
+	void SetUp() override {
+		tempDir = uniqueTempDirectory("comic_reader_thumbnails");
+		archive = tempDir / "comic.cbz";
+		packPath = tempDir / "thumbnails.pack";
+		std::ofstream(archive) << "archive";
+	}
+
+	void TearDown() override { std::filesystem::remove_all(tempDir); }
+};
+
+TEST_F(ThumbnailPackTest, PersistsAcrossInstances) {
+	Thumbnail thumbnail{3, 4, ".png", {1, 2, 3, 4, 5}};
+	{
+		ThumbnailPack pack(packPath);
+		EXPECT_FALSE(pack.find(archive));
+		EXPECT_TRUE(pack.add(archive, 10, thumbnail));
+		EXPECT_EQ(pack.read(archive), thumbnail.content);
+	}
+
+	ThumbnailPack pack(packPath);
+	auto entry = pack.find(archive);
+	ASSERT_TRUE(entry);
+	EXPECT_EQ(entry->pages, 10);
+	EXPECT_EQ(entry->width, 3);
+	EXPECT_EQ(entry->height, 4);
+	EXPECT_EQ(entry->extension, ".png");
+	EXPECT_EQ(pack.read(archive), thumbnail.content);
+}
+
+TEST_F(ThumbnailPackTest, InvalidatedByArchiveChange) {
+	ThumbnailPack pack(packPath);
+	EXPECT_TRUE(pack.add(archive, 10, {1, 1, ".jpg", {1}}));
+	std::ofstream(archive, std::ios::app) << "more pages";
+	EXPECT_FALSE(pack.find(archive));
+
+	EXPECT_TRUE(pack.add(archive, 12, {1, 1, ".jpg", {2}}));
+	ASSERT_TRUE(pack.find(archive));
+	EXPECT_EQ(pack.find(archive)->pages, 12);
+	EXPECT_EQ(pack.read(archive), std::vector<uint8_t>{2});
+}
+
+TEST_F(ThumbnailPackTest, RecoversFromTornWrite) {
+	{
+		ThumbnailPack pack(packPath);
+		EXPECT_TRUE(pack.add(archive, 10, {1, 1, ".jpg", {1, 2}}));
+	}
+	std::ofstream(packPath, std::ios::app | std::ios::binary) << "garbage";
+
+	auto other = tempDir / "other.cbz";
+	std::ofstream(other) << "other";
+	{
+		ThumbnailPack pack(packPath);
+		ASSERT_TRUE(pack.find(archive));
+		EXPECT_TRUE(pack.add(other, 5, {1, 1, ".gif", {3}}));
+	}
+
+	ThumbnailPack pack(packPath);
+	EXPECT_EQ(pack.read(archive), (std::vector<uint8_t>{1, 2}));
+	EXPECT_EQ(pack.read(other), std::vector<uint8_t>{3});
+}
+
+TEST_F(ThumbnailPackTest, CompactsReplacedRecords) {
+	auto removed = tempDir / "removed.cbz";
+	std::ofstream(removed) << "removed";
+	const std::vector<uint8_t> content(256 * 1024, 7);
+	{
+		ThumbnailPack pack(packPath);
+		EXPECT_TRUE(pack.add(removed, 1, {1, 1, ".jpg", {5}}));
+		for (int i = 0; i < 10; ++i) {
+			EXPECT_TRUE(pack.add(archive, 10, {1, 1, ".jpg", content}));
+		}
+	}
+	EXPECT_GT(std::filesystem::file_size(packPath), 10 * content.size());
+	std::filesystem::remove(removed);
+
+	// Opening drops the replaced records and those of deleted archives
+	ThumbnailPack pack(packPath);
+	EXPECT_LT(std::filesystem::file_size(packPath), 2 * content.size());
+	EXPECT_FALSE(pack.find(removed));
+	ASSERT_TRUE(pack.find(archive));
+	EXPECT_EQ(pack.read(archive), content);
+
+	// Still appendable, and compactable while open
+	EXPECT_TRUE(pack.add(archive, 3, {1, 1, ".png", {9}}));
+	pack.compact();
+	ASSERT_TRUE(pack.find(archive));
+	EXPECT_EQ(pack.find(archive)->pages, 3);
+	EXPECT_EQ(pack.read(archive), std::vector<uint8_t>{9});
+	EXPECT_LT(std::filesystem::file_size(packPath), 1024);
+}
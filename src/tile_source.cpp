@@ -0,0 +1,38 @@
+#include "tile_source.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+bool needsTiles(const wxSize& size) {
+	const auto pixels = static_cast<long long>(size.GetWidth()) *
+						size.GetHeight();
+	return pixels > TILE_THRESHOLD_PIXELS ||
+		   std::max(size.GetWidth(), size.GetHeight()) > TILE_THRESHOLD_SIDE;
+}
+
+TileSource::TileSource(const wxImage& image)
+	: pixels(MappedFile::copyOf(
+		  image.GetData(),
+		  static_cast<size_t>(image.GetWidth()) * image.GetHeight() * 3)),
+	  size(image.GetSize()),
+	  tileHeight(std::max(1, TILE_PIXELS / std::max(1, size.GetWidth()))) {}
+
+int TileSource::count() const {
+	return (size.GetHeight() + tileHeight - 1) / tileHeight;
+}
+
+wxRect TileSource::rect(int tile) const {
+	const auto top = tile * tileHeight;
+	return wxRect(
+		0, top, size.GetWidth(), std::min(tileHeight, size.GetHeight() - top));
+}
+
+wxImage TileSource::read(int tile) const {
+	const auto area = rect(tile);
+	const auto rowBytes = static_cast<size_t>(area.GetWidth()) * 3;
+	wxImage image(area.GetWidth(), area.GetHeight(), false);
+	std::memcpy(
+		image.GetData(), pixels.data() + area.GetTop() * rowBytes,
+		area.GetHeight() * rowBytes);
+	return image;
+}
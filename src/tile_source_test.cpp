@@ -0,0 +1,31 @@
+#include "tile_source.hpp"
+
+#include <gtest/gtest.h>
+
+TEST(tileSource, SplitsIntoStrips) {
+	EXPECT_FALSE(needsTiles(wxSize(2000, 3000)));
+	EXPECT_TRUE(needsTiles(wxSize(800, 30000)));
+	EXPECT_TRUE(needsTiles(wxSize(5000, 5000)));
+
+	const int W = 100, H = 3 * (TILE_PIXELS / W) + 7;
+	wxImage image(W, H, false);
+	auto* data = image.GetData();
+	for (int y = 0; y < H; ++y) {
+		for (int x = 0; x < W * 3; ++x) { data[y * W * 3 + x] = y % 251; }
+	}
+
+	TileSource source(image);
+	EXPECT_EQ(source.imageSize(), wxSize(W, H));
+	ASSERT_EQ(source.count(), 4);
+	EXPECT_EQ(source.rect(3).GetHeight(), 7);
+
+	for (int t = 0; t < source.count(); ++t) {
+		const auto rect = source.rect(t);
+		const auto tile = source.read(t);
+		ASSERT_EQ(tile.GetSize(), rect.GetSize());
+		EXPECT_EQ(tile.GetData()[0], rect.GetTop() % 251);
+		EXPECT_EQ(
+			tile.GetData()[(rect.GetHeight() * W - 1) * 3],
+			rect.GetBottom() % 251);
+	}
+}
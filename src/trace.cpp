@@ -0,0 +1,132 @@
+#include "trace.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct TraceEvent {
+	const char* name;
+	int64_t begin, end;
+};
+
+// Written by its own thread, the lock is only ever contended by start()
+// and stop()
+struct TraceBuffer {
+	std::mutex lock;
+	std::vector<TraceEvent> events;
+	size_t next = 0;
+	bool wrapped = false;
+	int tid;
+
+	TraceBuffer(int tid) : events(Trace::BUFFER_EVENTS), tid(tid) {}
+
+	void add(const TraceEvent& event) {
+		std::lock_guard<std::mutex> guard(lock);
+		events[next] = event;
+		if (++next == events.size()) {
+			next = 0;
+			wrapped = true;
+		}
+	}
+};
+
+std::atomic_bool Trace::on(false);
+
+// Every buffer, including those of threads that have exited since
+std::mutex buffersLock;
+std::vector<std::shared_ptr<TraceBuffer>> buffers;
+thread_local std::shared_ptr<TraceBuffer> threadBuffer;
+
+// Input to frame spans get a track of their own, they overlap the paints
+const int LATENCY_TID = 0;
+std::atomic<int64_t> pendingInput(-1);
+
+TraceBuffer& latencyBuffer() {
+	static const auto buffer = []() {
+		auto buffer = std::make_shared<TraceBuffer>(LATENCY_TID);
+		std::lock_guard<std::mutex> guard(buffersLock);
+		buffers.push_back(buffer);
+		return buffer;
+	}();
+	return *buffer;
+}
+
+void Trace::start() {
+	{
+		std::lock_guard<std::mutex> guard(buffersLock);
+		// Only this list still holds the buffers of exited threads, the
+		// latency buffer is held by latencyBuffer()
+		std::erase_if(buffers, [](const auto& buffer) {
+			return buffer.use_count() == 1;
+		});
+		for (auto& buffer : buffers) {
+			std::lock_guard<std::mutex> bufferGuard(buffer->lock);
+			buffer->next = 0;
+			buffer->wrapped = false;
+		}
+	}
+	pendingInput.store(-1);
+	on.store(true);
+}
+
+bool Trace::stop(const std::filesystem::path& file) {
+	on.store(false);
+	std::ofstream output(file, std::ios::trunc);
+	output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	output << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+		   << LATENCY_TID << ",\"args\":{\"name\":\"Input to frame\"}}";
+
+	std::lock_guard<std::mutex> guard(buffersLock);
+	for (auto& buffer : buffers) {
+		std::lock_guard<std::mutex> bufferGuard(buffer->lock);
+		const auto size = buffer->events.size();
+		const auto count = buffer->wrapped ? size : buffer->next;
+		const auto first = buffer->wrapped ? buffer->next : 0;
+		for (size_t i = 0; i < count; ++i) {
+			const auto& event =
+				buffer->events[(first + i) % size];
+			// Complete events in microseconds
+			char line[64];
+			std::snprintf(
+				line, sizeof(line), "\"ts\":%.3f,\"dur\":%.3f",
+				event.begin / 1000.0, (event.end - event.begin) / 1000.0);
+			output << ",\n{\"name\":\"" << event.name
+				   << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+				   << "," << line << "}";
+		}
+	}
+	output << "]}\n";
+	return bool(output.flush());
+}
+
+int64_t Trace::now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			   std::chrono::steady_clock::now().time_since_epoch())
+		.count();
+}
+
+void Trace::record(const char* name, int64_t begin, int64_t end) {
+	if (!threadBuffer) {
+		static std::atomic_int nextTid(LATENCY_TID + 1);
+		threadBuffer = std::make_shared<TraceBuffer>(nextTid++);
+		std::lock_guard<std::mutex> guard(buffersLock);
+		buffers.push_back(threadBuffer);
+	}
+	threadBuffer->add({name, begin, end});
+}
+
+void Trace::input() {
+	if (!enabled()) { return; }
+	// Measured from the first of the keys handled by the same frame
+	int64_t none = -1;
+	pendingInput.compare_exchange_strong(none, now());
+}
+
+void Trace::frame(int64_t end) {
+	const auto begin = pendingInput.exchange(-1);
+	if (begin < 0) { return; }
+	latencyBuffer().add({"Input to frame", begin, end});
+}
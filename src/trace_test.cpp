@@ -0,0 +1,74 @@
+#include "trace.hpp"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+std::string stopTrace() {
+	const auto file =
+		std::filesystem::temp_directory_path() / "comic_reader_trace.json";
+	EXPECT_TRUE(Trace::stop(file));
+	std::ifstream input(file);
+	std::stringstream content;
+	content << input.rdbuf();
+	std::filesystem::remove(file);
+	return content.str();
+}
+
+size_t countOf(const std::string& text, const std::string& part) {
+	size_t count = 0;
+	for (auto pos = text.find(part); pos != std::string::npos;
+		 pos = text.find(part, pos + 1)) {
+		++count;
+	}
+	return count;
+}
+
+TEST(trace, RecordsSpansOnlyWhileEnabled) {
+	{ TraceSpan span("before"); }
+	Trace::start();
+	EXPECT_TRUE(Trace::enabled());
+	{ TraceSpan span("during"); }
+	std::thread([]() { TraceSpan span("other thread"); }).join();
+	const auto trace = stopTrace();
+	EXPECT_FALSE(Trace::enabled());
+	{ TraceSpan span("after"); }
+
+	EXPECT_EQ(trace.front(), '{');
+	EXPECT_EQ(countOf(trace, "\"during\""), 1);
+	EXPECT_EQ(countOf(trace, "\"other thread\""), 1);
+	EXPECT_EQ(countOf(trace, "\"before\""), 0);
+	EXPECT_EQ(countOf(stopTrace(), "\"after\""), 0);
+}
+
+TEST(trace, KeepsNewestEvents) {
+	Trace::start();
+	for (size_t i = 0; i < Trace::BUFFER_EVENTS; ++i) {
+		Trace::record("old", 0, 1);
+	}
+	Trace::record("new", 0, 1);
+	const auto trace = stopTrace();
+	EXPECT_EQ(countOf(trace, "\"old\""), Trace::BUFFER_EVENTS - 1);
+	EXPECT_EQ(countOf(trace, "\"new\""), 1);
+
+	// Starting again drops the earlier events
+	Trace::start();
+	EXPECT_EQ(countOf(stopTrace(), "\"old\""), 0);
+}
+
+TEST(trace, MeasuresInputToFrame) {
+	Trace::start();
+	{ TraceSpan paint("paint", true); }
+	Trace::input();
+	Trace::input();
+	{ TraceSpan paint("paint", true); }
+	{ TraceSpan paint("paint", true); }
+	const auto trace = stopTrace();
+	EXPECT_EQ(countOf(trace, "\"paint\""), 3);
+	// Both keys were handled by the second frame
+	EXPECT_EQ(countOf(trace, "\"name\":\"Input to frame\",\"ph\":\"X\""), 1);
+}
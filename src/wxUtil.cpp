@@ -77,3 +77,10 @@ void drawBottomText(
 	double y = ch - h;
 	gc->DrawText(text, (cw - w) / 2, y);
 }
+
+void drawPlaceholder(
+	wxGraphicsContext* gc, const double x, const double y, const double w,
+	const double h) {
+	gc->SetBrush(wxBrush(wxColour(50, 50, 50)));
+	gc->DrawRectangle(x, y, w, h);
+}